@@ -0,0 +1,142 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2014 John Sparger <jsparger87@gmail.com>
+//
+// Distributed under the Boost Software License, Version 1.0
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// See https://github.com/jsparger/pipe for more information.
+//---------------------------------------------------------------------------//
+
+#ifndef PIPE_BINARY_IO_HH
+#define PIPE_BINARY_IO_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace pipe {
+
+/// \class BinaryIO
+/// \brief Helpers for reading and writing fixed-width little-endian integers to byte buffers.
+///
+/// The binary formats written by pipe (for example by BundleFileSink) are little-endian regardless of the host, so files can be moved between machines.
+struct BinaryIO
+{
+	/// Append the low \p width bytes of \p value to \p out, least significant byte first.
+	static void Put(std::string& out, std::uint64_t value, std::size_t width)
+	{
+		for (std::size_t i = 0; i < width; ++i)
+		{
+			out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+		}
+	}
+
+	/// Append a 32 bit value to \p out.
+	static void Put32(std::string& out, std::uint32_t value) { Put(out, value, 4); }
+
+	/// Append a 64 bit value to \p out.
+	static void Put64(std::string& out, std::uint64_t value) { Put(out, value, 8); }
+
+	/// Append the bits of the double \p value to \p out.
+	static void PutDouble(std::string& out, double value)
+	{
+		std::uint64_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		Put64(out, bits);
+	}
+
+	/// Append a 32 bit length followed by the bytes of \p s to \p out.
+	static void PutString(std::string& out, const std::string& s)
+	{
+		Put32(out, static_cast<std::uint32_t>(s.size()));
+		out.append(s);
+	}
+
+	/// Read a \p width byte value from \p in.
+	static std::uint64_t Get(const char* in, std::size_t width)
+	{
+		std::uint64_t value = 0;
+		for (std::size_t i = 0; i < width; ++i)
+		{
+			value |= static_cast<std::uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+		}
+		return value;
+	}
+
+	/// Read a 32 bit value from \p in.
+	static std::uint32_t Get32(const char* in) { return static_cast<std::uint32_t>(Get(in, 4)); }
+
+	/// Read a 64 bit value from \p in.
+	static std::uint64_t Get64(const char* in) { return Get(in, 8); }
+
+	/// 32 bit FNV-1a hash of \p size bytes at \p data. Used as a cheap checksum.
+	static std::uint32_t Checksum(const char* data, std::size_t size)
+	{
+		std::uint32_t hash = 2166136261u;
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			hash ^= static_cast<unsigned char>(data[i]);
+			hash *= 16777619u;
+		}
+		return hash;
+	}
+};
+
+/// \class BinaryReader
+/// \brief Reads values written with BinaryIO back out of a buffer, in order.
+///
+/// Reading past the end of the buffer throws std::runtime_error.
+class BinaryReader
+{
+public:
+	/// Constructor. Reads from \p buffer, which must outlive the reader.
+	BinaryReader(const std::string& buffer)
+		: 	buffer(buffer), pos(0)
+	{
+		// do nothing else
+	}
+
+	/// Read a 32 bit value.
+	std::uint32_t get32() { return BinaryIO::Get32(take(4)); }
+
+	/// Read a 64 bit value.
+	std::uint64_t get64() { return BinaryIO::Get64(take(8)); }
+
+	/// Read a double written with BinaryIO::PutDouble().
+	double getDouble()
+	{
+		std::uint64_t bits = get64();
+		double value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	/// Read a string written with BinaryIO::PutString().
+	std::string getString()
+	{
+		std::uint32_t size = get32();
+		return std::string(take(size), size);
+	}
+
+	/// The number of bytes not yet read.
+	std::size_t remaining() const { return buffer.size() - pos; }
+
+private:
+	const char* take(std::size_t size)
+	{
+		if (size > remaining()) { throw std::runtime_error("BinaryReader: read past end of buffer"); }
+		const char* p = buffer.data() + pos;
+		pos += size;
+		return p;
+	}
+
+	const std::string& buffer;
+	std::size_t pos;
+};
+
+} // namespace pipe
+
+#endif
@@ -0,0 +1,164 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2014 John Sparger <jsparger87@gmail.com>
+//
+// Distributed under the Boost Software License, Version 1.0
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// See https://github.com/jsparger/pipe for more information.
+//---------------------------------------------------------------------------//
+
+#ifndef PIPE_BLOCK_CODEC_HH
+#define PIPE_BLOCK_CODEC_HH
+
+#include "pipe/BinaryIO.hh"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace pipe {
+
+/// \class BlockCodec
+/// \brief A small, fast LZ77 compressor for blocks of serialized bundles.
+///
+/// BlockCodec trades compression ratio for speed, in the spirit of LZ4, and has no external dependencies. A compressed block is a series of sequences. Each sequence is a token byte (literal length in the high nibble, match length minus 4 in the low nibble, 15 meaning more length bytes follow), the literals, then a 2 byte match offset and any extra match length bytes. The last sequence has literals only. The decompressor must be told the size of the original data.
+struct BlockCodec
+{
+	/// Compress \p in and return the compressed bytes.
+	static std::string Compress(const std::string& in)
+	{
+		const std::size_t minMatch = 4;
+		const std::size_t maxOffset = 65535;
+		const std::size_t n = in.size();
+		const char* src = in.data();
+
+		std::string out;
+		out.reserve(n / 2 + 16);
+
+		// positions + 1 of recently seen 4 byte sequences, indexed by hash. 0 means empty.
+		std::vector<std::uint32_t> table(1 << hashBits, 0);
+
+		std::size_t anchor = 0;
+		std::size_t i = 0;
+		while (i + minMatch <= n)
+		{
+			std::uint32_t seq = read32(src + i);
+			std::uint32_t h = (seq * 2654435761u) >> (32 - hashBits);
+			std::size_t candidate = table[h];
+			table[h] = static_cast<std::uint32_t>(i + 1);
+
+			if (0 == candidate || i - (candidate - 1) > maxOffset || read32(src + candidate - 1) != seq)
+			{
+				++i;
+				continue;
+			}
+
+			std::size_t match = candidate - 1;
+			std::size_t length = minMatch;
+			while (i + length < n && src[match + length] == src[i + length]) { ++length; }
+
+			putSequence(out, src + anchor, i - anchor, i - match, length - minMatch);
+			i += length;
+			anchor = i;
+		}
+
+		// the remaining bytes go out as literals in a final sequence.
+		putLiterals(out, src + anchor, n - anchor, 0);
+		return out;
+	}
+
+	/// Decompress \p in, which must expand to exactly \p rawSize bytes. Throws std::runtime_error if the data is corrupt.
+	static std::string Decompress(const std::string& in, std::size_t rawSize)
+	{
+		// rawSize may come from a corrupt file, so don't reserve more than
+		// the input could possibly expand to.
+		std::string out;
+		out.reserve(std::min<std::size_t>(rawSize, in.size() * 256));
+
+		const unsigned char* ip = reinterpret_cast<const unsigned char*>(in.data());
+		const unsigned char* end = ip + in.size();
+
+		while (ip < end)
+		{
+			unsigned token = *ip++;
+
+			std::size_t literals = getLength(ip, end, token >> 4);
+			if (literals > static_cast<std::size_t>(end - ip) || out.size() + literals > rawSize) { corrupt(); }
+			out.append(reinterpret_cast<const char*>(ip), literals);
+			ip += literals;
+
+			// the final sequence has no match.
+			if (ip == end) { break; }
+
+			if (end - ip < 2) { corrupt(); }
+			std::size_t offset = ip[0] | (ip[1] << 8);
+			ip += 2;
+			std::size_t length = getLength(ip, end, token & 0x0f) + 4;
+			if (0 == offset || offset > out.size() || out.size() + length > rawSize) { corrupt(); }
+
+			// matches may overlap the bytes they produce, so copy one at a time.
+			std::size_t from = out.size() - offset;
+			for (std::size_t k = 0; k < length; ++k) { out.push_back(out[from + k]); }
+		}
+
+		if (out.size() != rawSize) { corrupt(); }
+		return out;
+	}
+
+private:
+	static const unsigned hashBits = 14;
+
+	static std::uint32_t read32(const char* p)
+	{
+		std::uint32_t v;
+		std::memcpy(&v, p, 4);
+		return v;
+	}
+
+	static void putExtraLength(std::string& out, std::size_t length)
+	{
+		for (; length >= 255; length -= 255) { out.push_back(static_cast<char>(255)); }
+		out.push_back(static_cast<char>(length));
+	}
+
+	static void putLiterals(std::string& out, const char* literals, std::size_t count, unsigned matchNibble)
+	{
+		unsigned litNibble = count < 15 ? static_cast<unsigned>(count) : 15;
+		out.push_back(static_cast<char>((litNibble << 4) | matchNibble));
+		if (15 == litNibble) { putExtraLength(out, count - 15); }
+		out.append(literals, count);
+	}
+
+	static void putSequence(std::string& out, const char* literals, std::size_t count, std::size_t offset, std::size_t matchExtra)
+	{
+		unsigned matchNibble = matchExtra < 15 ? static_cast<unsigned>(matchExtra) : 15;
+		putLiterals(out, literals, count, matchNibble);
+		BinaryIO::Put(out, offset, 2);
+		if (15 == matchNibble) { putExtraLength(out, matchExtra - 15); }
+	}
+
+	static std::size_t getLength(const unsigned char*& ip, const unsigned char* end, unsigned nibble)
+	{
+		std::size_t length = nibble;
+		if (15 != nibble) { return length; }
+		unsigned char b;
+		do
+		{
+			if (ip == end) { corrupt(); }
+			b = *ip++;
+			length += b;
+		} while (255 == b);
+		return length;
+	}
+
+	static void corrupt()
+	{
+		throw std::runtime_error("BlockCodec::Decompress(...): corrupt block!");
+	}
+};
+
+} // namespace pipe
+
+#endif
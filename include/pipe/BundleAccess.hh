@@ -41,8 +41,11 @@ public:
 		if (map.count(T::GetMessageType()) == 0) { return false; }
 		
 		// get the message. Store the unwrapped object in "message" and signal success.
-		core::any wrapped = map[T::GetMessageType()];
-		message = core::any_cast<T>(wrapped);
+		// A lazy message is computed here if nobody has read it yet.
+		core::any& wrapped = map[T::GetMessageType()];
+		const T* unwrapped = unwrap<T>(wrapped);
+		if (nullptr == unwrapped) { throw core::bad_any_cast(); }
+		message = *unwrapped;
 		return true;
 	}
 	
@@ -61,7 +64,7 @@ public:
 		
 		// http://www.boost.org/doc/libs/1_42_0/doc/html/boost/any_cast.html
 		// as of may 31 using core library from https://github.com/mnmlstc/core
-		return *core::any_cast<T>(&wrapped);
+		return *unwrap<T>(wrapped);
 	}
 	
 	/// Attach the message of type T to the bundle. Returns false if message of type T has already been attached to bundle
@@ -75,11 +78,47 @@ public:
 			if (map.count(T::GetMessageType()) == 1) { return false; }
 			
 			map[T::GetMessageType()] = core::any(message);
+			account(*bundle, T::GetMessageType(), MessageSize<T>::Of(message));
 			
 			return true;
 	}
 	
-	/// Check to see if a message of type \p T exists in the bundle.
+	/// Attach a message of type T which will be computed by \p producer the first time it is read with readFrom() or readRef(). The computed message is cached in the bundle. Returns false if message of type T has already been attached to bundle.
+	virtual bool attachLazy(std::unique_ptr<MessageBundle>& bundle, typename LazyMessage<T>::Producer producer)
+	{
+		// get the map from the bundle
+		MessageBundle::MessageMap& map = getMap(*bundle.get());
+		
+		if (map.count(T::GetMessageType()) == 1) { return false; }
+		
+		map[T::GetMessageType()] = core::any(std::make_shared<LazyMessage<T>>(std::move(producer)));
+		
+		return true;
+	}
+	
+	/// Attach immutable data of type T shared with other bundles. Only the pointer is copied. Returns false if message of type T has already been attached to bundle. See SharedPayload.
+	virtual bool attachShared(std::unique_ptr<MessageBundle>& bundle, std::shared_ptr<const T> message)
+	{
+		// get the map from the bundle
+		MessageBundle::MessageMap& map = getMap(*bundle.get());
+		
+		if (map.count(T::GetMessageType()) == 1) { return false; }
+		
+		map[T::GetMessageType()] = core::any(std::move(message));
+		
+		return true;
+	}
+	
+	/// Remove the message of type T from the bundle. Returns false if there was no message of type T.
+	virtual bool detachFrom(std::unique_ptr<MessageBundle>& bundle)
+	{
+		// get the map from the bundle
+		MessageBundle::MessageMap& map = getMap(*bundle.get());
+		unaccount(*bundle, T::GetMessageType());
+		return (map.erase(T::GetMessageType()) == 1);
+	}
+	
+	/// Check to see if a message of type \p T exists in the bundle. A lazy message counts as present and is not computed.
 	virtual bool hasMessage(std::unique_ptr<MessageBundle>& bundle)
 	{
 		// get the map from the bundle
@@ -115,7 +154,7 @@ public:
 		// TODO: throw a real error.
 		if (map.end() == it) { std::cerr << "BundleAccess::readRef(...): Error! No message of requested type!"; std::exit(0); }
 		core::any& theAny = it->second;
-		T* ret = core::any_cast<T>(&theAny);
+		const T* ret = unwrap<T>(theAny);
 		return *ret;
 	}
 	
@@ -126,6 +165,23 @@ public:
 		auto& map = getMap(*bundle);
 		auto pair = map.emplace(name, core::any(message));
 		std::cout << "insert = " << pair.second << "\n";
+		if (pair.second) { account(*bundle, name, MessageSize<T>::Of(message)); }
+		return pair.second;
+	}
+	
+	/// Attach data which will be computed by \p producer the first time it is read with readRef() and associate it with the string \p name. Returns false if \p name is already in use.
+	virtual bool attachLazy(std::unique_ptr<MessageBundle>& bundle, typename LazyMessage<T>::Producer producer, const std::string& name)
+	{
+		auto& map = getMap(*bundle);
+		auto pair = map.emplace(name, core::any(std::make_shared<LazyMessage<T>>(std::move(producer))));
+		return pair.second;
+	}
+	
+	/// Attach immutable data shared with other bundles and associate it with the string \p name. Only the pointer is copied. Returns false if \p name is already in use.
+	virtual bool attachShared(std::unique_ptr<MessageBundle>& bundle, std::shared_ptr<const T> message, const std::string& name)
+	{
+		auto& map = getMap(*bundle);
+		auto pair = map.emplace(name, core::any(std::move(message)));
 		return pair.second;
 	}
 };
@@ -0,0 +1,191 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2014 John Sparger <jsparger87@gmail.com>
+//
+// Distributed under the Boost Software License, Version 1.0
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// See https://github.com/jsparger/pipe for more information.
+//---------------------------------------------------------------------------//
+
+#ifndef PIPE_BUNDLE_FILE_HH
+#define PIPE_BUNDLE_FILE_HH
+
+#include "pipe/BinaryIO.hh"
+#include "pipe/BlockCodec.hh"
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pipe {
+
+/// \class BundleFileFormat
+/// \brief Layout of the block files written by BundleFileSink.
+///
+/// A bundle file is a header, a series of independent blocks, an index of the blocks and a trailer pointing at the index. All integers are little-endian (see BinaryIO).
+/// - header: "PIPEBNDL", u32 version
+/// - block: "PBLK", u32 flags, u64 raw size, u64 stored size, u64 first bundle number, u32 bundle count, u32 checksum of the stored bytes, then the stored bytes. If flags has Compressed set the stored bytes are BlockCodec output.
+/// - index: "PIDX", u64 entry count, then per block: u64 file offset, u64 first bundle number, u32 bundle count
+/// - trailer: u64 index offset, "PEND"
+///
+/// The raw bytes of a block are a series of records, one per bundle: u32 message count, then for each message a length prefixed message key and a length prefixed serialized message.
+struct BundleFileFormat
+{
+	static const std::uint32_t Version = 1;
+	static const std::uint32_t Compressed = 1;
+	static const std::size_t HeaderSize = 12;
+	static const std::size_t BlockHeaderSize = 40;
+	static const std::size_t IndexEntrySize = 20;
+	static const std::size_t TrailerSize = 12;
+
+	/// One entry of the block index.
+	struct IndexEntry
+	{
+		std::uint64_t offset;
+		std::uint64_t firstBundle;
+		std::uint32_t bundleCount;
+	};
+};
+
+/// \class BundleFileReader
+/// \brief Reads the blocks of a file written by BundleFileSink.
+///
+/// The reader loads the block index when it is opened, so any block can be read on its own. To read a file in parallel, give each thread its own BundleFileReader and a share of the blocks. Errors are reported by throwing std::runtime_error.
+class BundleFileReader
+{
+public:
+	/// A message read back from a file: the message key and the serialized message.
+	typedef std::pair<std::string, std::string> Entry;
+	/// All the messages of one bundle.
+	typedef std::vector<Entry> Record;
+
+	/// Constructor. Opens the file at \p path and reads its index.
+	BundleFileReader(const std::string& path)
+		: 	file(path.c_str(), std::ios::binary), size(0)
+	{
+		if (!file) { fail("cannot open " + path); }
+
+		file.seekg(0, std::ios::end);
+		size = file.tellg();
+		if (size < BundleFileFormat::HeaderSize + BundleFileFormat::TrailerSize) { fail("file is truncated"); }
+
+		std::string header = readAt(0, BundleFileFormat::HeaderSize);
+		if (header.compare(0, 8, "PIPEBNDL") != 0) { fail("not a bundle file"); }
+		if (BinaryIO::Get32(&header[8]) != BundleFileFormat::Version) { fail("unknown version"); }
+
+		std::string trailer = readAt(size - BundleFileFormat::TrailerSize, BundleFileFormat::TrailerSize);
+		if (trailer.compare(8, 4, "PEND") != 0) { fail("missing trailer, file was not closed"); }
+		std::uint64_t indexOffset = BinaryIO::Get64(&trailer[0]);
+
+		// the index sits between the header and the trailer. Check the
+		// offset and entry count against that space before trusting them.
+		std::uint64_t indexEnd = size - BundleFileFormat::TrailerSize;
+		if (indexOffset < BundleFileFormat::HeaderSize || indexOffset > indexEnd || indexEnd - indexOffset < 12) { fail("bad index offset"); }
+
+		std::string head = readAt(indexOffset, 12);
+		if (head.compare(0, 4, "PIDX") != 0) { fail("bad index"); }
+		std::uint64_t count = BinaryIO::Get64(&head[4]);
+		if (count > (indexEnd - indexOffset - 12) / BundleFileFormat::IndexEntrySize) { fail("bad index entry count"); }
+
+		std::string entries = readAt(indexOffset + 12, count * BundleFileFormat::IndexEntrySize);
+		for (std::uint64_t i = 0; i < count; ++i)
+		{
+			const char* p = &entries[i * BundleFileFormat::IndexEntrySize];
+			BundleFileFormat::IndexEntry e;
+			e.offset = BinaryIO::Get64(p);
+			e.firstBundle = BinaryIO::Get64(p + 8);
+			e.bundleCount = BinaryIO::Get32(p + 16);
+			index.push_back(e);
+		}
+	}
+
+	/// The block index.
+	const std::vector<BundleFileFormat::IndexEntry>& getIndex() const
+	{
+		return index;
+	}
+
+	/// Read block number \p i and return its raw (decompressed) bytes.
+	std::string readBlock(std::size_t i)
+	{
+		std::string header = readAt(index.at(i).offset, BundleFileFormat::BlockHeaderSize);
+		if (header.compare(0, 4, "PBLK") != 0) { fail("bad block header"); }
+		std::uint32_t flags = BinaryIO::Get32(&header[4]);
+		std::uint64_t rawSize = BinaryIO::Get64(&header[8]);
+		std::uint64_t storedSize = BinaryIO::Get64(&header[16]);
+		std::uint32_t checksum = BinaryIO::Get32(&header[36]);
+		if (storedSize > size - index[i].offset - BundleFileFormat::BlockHeaderSize) { fail("bad block size"); }
+
+		std::string stored = readAt(index[i].offset + BundleFileFormat::BlockHeaderSize, storedSize);
+		if (BinaryIO::Checksum(stored.data(), stored.size()) != checksum) { fail("block checksum mismatch"); }
+
+		if (flags & BundleFileFormat::Compressed)
+		{
+			return BlockCodec::Decompress(stored, rawSize);
+		}
+		return stored;
+	}
+
+	/// Split the raw bytes of a block into one Record per bundle.
+	static std::vector<Record> ParseBlock(const std::string& raw)
+	{
+		std::vector<Record> records;
+		std::size_t pos = 0;
+		while (pos < raw.size())
+		{
+			std::uint32_t messages = static_cast<std::uint32_t>(BinaryIO::Get32(need(raw, pos, 4)));
+			pos += 4;
+			Record record;
+			for (std::uint32_t m = 0; m < messages; ++m)
+			{
+				std::string key = getString(raw, pos);
+				std::string text = getString(raw, pos);
+				record.push_back(Entry(std::move(key), std::move(text)));
+			}
+			records.push_back(std::move(record));
+		}
+		return records;
+	}
+
+private:
+	std::string readAt(std::uint64_t offset, std::uint64_t length)
+	{
+		if (offset > size || length > size - offset) { fail("unexpected end of file"); }
+		std::string buffer(length, '\0');
+		file.clear();
+		file.seekg(offset);
+		if (length && !file.read(&buffer[0], length)) { fail("unexpected end of file"); }
+		return buffer;
+	}
+
+	static const char* need(const std::string& raw, std::size_t pos, std::size_t size)
+	{
+		if (pos + size > raw.size()) { fail("truncated record"); }
+		return raw.data() + pos;
+	}
+
+	static std::string getString(const std::string& raw, std::size_t& pos)
+	{
+		std::uint32_t size = BinaryIO::Get32(need(raw, pos, 4));
+		pos += 4;
+		std::string s(need(raw, pos, size), size);
+		pos += size;
+		return s;
+	}
+
+	static void fail(const std::string& what)
+	{
+		throw std::runtime_error("BundleFileReader: " + what);
+	}
+
+	std::ifstream file;
+	/// The size of the file in bytes. Offsets and sizes read from the file are checked against it.
+	std::uint64_t size;
+	std::vector<BundleFileFormat::IndexEntry> index;
+};
+
+} // namespace pipe
+
+#endif
@@ -0,0 +1,308 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2014 John Sparger <jsparger87@gmail.com>
+//
+// Distributed under the Boost Software License, Version 1.0
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// See https://github.com/jsparger/pipe for more information.
+//---------------------------------------------------------------------------//
+
+#ifndef PIPE_BUNDLE_FILE_SINK_HH
+#define PIPE_BUNDLE_FILE_SINK_HH
+
+#include "pipe/Module.hh"
+#include "pipe/BundleAccess.hh"
+#include "pipe/BundleFile.hh"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace pipe {
+
+// Same compile-time recursion as BundlePrinter: serialize the message for
+// the first type if it is in the bundle, then move on to the rest.
+template <class... Args>
+struct BundleSerializer
+{
+	static std::uint32_t Append(std::unique_ptr<MessageBundle>&, std::string&)
+	{
+		// parameter pack is empty
+		return 0;
+	}
+};
+
+template <class T, class... Args>
+struct BundleSerializer<T,Args...>
+{
+	static std::uint32_t Append(std::unique_ptr<MessageBundle>& b, std::string& out)
+	{
+		BundleAccess<T> access;
+		std::uint32_t written = 0;
+		if (access.hasMessage(b))
+		{
+			std::ostringstream text;
+			text << access.readRef(b);
+			BinaryIO::PutString(out, T::GetMessageType());
+			BinaryIO::PutString(out, text.str());
+			written = 1;
+		}
+		return written + BundleSerializer<Args...>::Append(b, out);
+	}
+};
+
+/// \class BundleFileSink
+/// \brief A module which writes bundles to a block compressed file without stalling the pipeline on disk I/O.
+///
+/// The sink serializes the messages of types \p Args (which must be printable and have a GetMessageType() method, as for BundlePrintModule) into a block in memory. When the block is full it is handed to a background thread, which compresses it with BlockCodec and writes it to the file with one large sequential write. The sink owns a fixed number of block buffers, so while the background thread writes one block the module fills the next. The module only waits if every buffer is waiting to be written.
+///
+/// A block is also handed off at every SOFT_RESET, so blocks never span a reset. When the module shuts down, the remaining data, the block index and the trailer are written. See BundleFileFormat for the layout and BundleFileReader to read the file back.
+///
+/// If the file cannot be opened or written, the sink throws std::runtime_error, which makes the Pipeline shut down and rethrow it. A failed write is noticed by the module at the next block hand off, or at the latest in cleanUp().
+template <class... Args>
+class BundleFileSink : public Module
+{
+public:
+	/// Constructor. Writes to the file at \p path. Blocks are handed off once they reach \p blockSize bytes. \p buffers is the number of block buffers (2 for double buffering).
+	BundleFileSink(const std::string& path, std::size_t blockSize = 4 << 20, std::size_t buffers = 2)
+		: 	path(path), blockSize(blockSize), bufferCount(buffers < 2 ? 2 : buffers),
+			bundleNumber(0), firstInBlock(0), stopping(false), writeFailed(false), fileOffset(0)
+	{
+		// do nothing else
+	}
+
+	/// Destructor
+	virtual ~BundleFileSink() {;}
+
+protected:
+
+	/// Opens the file and starts the background writer. Throws std::runtime_error if the file cannot be opened or written.
+	virtual void initialize() override
+	{
+		file.open(path.c_str(), std::ios::binary | std::ios::trunc);
+		if (!file) { fail("cannot open " + path); }
+
+		std::string header("PIPEBNDL");
+		BinaryIO::Put32(header, BundleFileFormat::Version);
+		file.write(header.data(), header.size());
+		if (!file)
+		{
+			file.close();
+			fail("cannot write to " + path);
+		}
+		fileOffset = header.size();
+		writeFailed = false;
+
+		current.reserve(blockSize + blockSize / 8);
+		for (std::size_t i = 1; i < bufferCount; ++i)
+		{
+			freeBuffers.push_back(std::string());
+			freeBuffers.back().reserve(blockSize + blockSize / 8);
+		}
+
+		stopping = false;
+		writer = std::thread(&BundleFileSink::writeBlocks, this);
+	}
+
+	/// Serializes the bundle into the current block.
+	virtual void processData() override
+	{
+		std::size_t start = current.size();
+		BinaryIO::Put32(current, 0);
+		std::uint32_t messages = BundleSerializer<Args...>::Append(bundle, current);
+
+		// go back and fill in the number of messages.
+		std::string count;
+		BinaryIO::Put32(count, messages);
+		current.replace(start, 4, count);
+
+		++bundleNumber;
+		if (current.size() >= blockSize) { handOff(); }
+	}
+
+	/// Hands off the current block so blocks do not span a SOFT_RESET.
+	virtual void reset() override
+	{
+		handOff();
+	}
+
+	/// Writes the remaining data, the index and the trailer, and closes the file. Throws std::runtime_error if any of the file could not be written.
+	virtual void cleanUp() override
+	{
+		// a failed write is reported below, once the writer has stopped.
+		try { handOff(); } catch (std::runtime_error&) {;}
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stopping = true;
+		}
+		queueCv.notify_all();
+		if (writer.joinable()) { writer.join(); }
+
+		// initialize() failed, so there is nothing to finish.
+		if (false == file.is_open())
+		{
+			Module::cleanUp();
+			return;
+		}
+
+		std::string index("PIDX");
+		BinaryIO::Put64(index, indexEntries.size());
+		for (auto& e : indexEntries)
+		{
+			BinaryIO::Put64(index, e.offset);
+			BinaryIO::Put64(index, e.firstBundle);
+			BinaryIO::Put32(index, e.bundleCount);
+		}
+		BinaryIO::Put64(index, fileOffset);
+		index.append("PEND");
+		if (false == writeFailed) { file.write(index.data(), index.size()); }
+		bool failed = writeFailed || !file;
+		file.close();
+
+		Module::cleanUp();
+		if (failed) { fail("write to " + path + " failed"); }
+	}
+
+	/// Queues the current block for writing and takes a free buffer to continue in. Blocks only if every buffer is in use. Throws std::runtime_error if the writer has failed.
+	virtual void handOff()
+	{
+		if (writeFailed) { fail("write to " + path + " failed"); }
+		if (current.empty()) { return; }
+
+		std::unique_lock<std::mutex> lock(queueMutex);
+		queueCv.wait(lock, [this]{ return false == this->freeBuffers.empty(); });
+
+		Block block;
+		block.data.swap(current);
+		block.firstBundle = firstInBlock;
+		block.bundleCount = static_cast<std::uint32_t>(bundleNumber - firstInBlock);
+		queue.push_back(std::move(block));
+		if (MemoryAccounting::IsEnabled())
+		{
+			queue.back().accounted = queue.back().data.size();
+			MemoryAccounting::AddBytes(AccountingKey(), queue.back().accounted);
+		}
+
+		current.swap(freeBuffers.back());
+		freeBuffers.pop_back();
+		firstInBlock = bundleNumber;
+
+		lock.unlock();
+		queueCv.notify_all();
+	}
+
+	/// A serialized block waiting to be written.
+	struct Block
+	{
+		std::string data;
+		std::uint64_t firstBundle;
+		std::uint32_t bundleCount;
+		/// Bytes reported to MemoryAccounting while the block waits.
+		std::size_t accounted = 0;
+	};
+	
+	/// The key queued blocks are reported under in MemoryAccounting.
+	static const std::string& AccountingKey()
+	{
+		static std::string key = "pipe::BundleFileSink";
+		return key;
+	}
+
+	/// The body of the background writer thread.
+	void writeBlocks()
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		while (true)
+		{
+			queueCv.wait(lock, [this]{ return this->stopping || false == this->queue.empty(); });
+			if (queue.empty()) { return; }
+
+			Block block = std::move(queue.front());
+			queue.pop_front();
+			lock.unlock();
+
+			writeBlock(block);
+			if (block.accounted) { MemoryAccounting::RemoveBytes(AccountingKey(), block.accounted); }
+
+			// give the buffer back for reuse.
+			block.data.clear();
+			lock.lock();
+			freeBuffers.push_back(std::move(block.data));
+			queueCv.notify_all();
+		}
+	}
+
+	/// Compresses and writes one block. Only called from the writer thread. After a failed write the remaining blocks are dropped.
+	void writeBlock(const Block& block)
+	{
+		if (writeFailed) { return; }
+
+		std::string stored = BlockCodec::Compress(block.data);
+		std::uint32_t flags = BundleFileFormat::Compressed;
+		if (stored.size() >= block.data.size())
+		{
+			// incompressible. Store the raw bytes instead.
+			stored = block.data;
+			flags = 0;
+		}
+
+		std::string header("PBLK");
+		BinaryIO::Put32(header, flags);
+		BinaryIO::Put64(header, block.data.size());
+		BinaryIO::Put64(header, stored.size());
+		BinaryIO::Put64(header, block.firstBundle);
+		BinaryIO::Put32(header, block.bundleCount);
+		BinaryIO::Put32(header, BinaryIO::Checksum(stored.data(), stored.size()));
+
+		file.write(header.data(), header.size());
+		file.write(stored.data(), stored.size());
+		if (!file)
+		{
+			// the module thread reports this at its next hand off.
+			writeFailed = true;
+			return;
+		}
+
+		BundleFileFormat::IndexEntry e;
+		e.offset = fileOffset;
+		e.firstBundle = block.firstBundle;
+		e.bundleCount = block.bundleCount;
+		indexEntries.push_back(e);
+		fileOffset += header.size() + stored.size();
+	}
+
+	static void fail(const std::string& what)
+	{
+		throw std::runtime_error("BundleFileSink: " + what);
+	}
+
+	std::string path;
+	std::size_t blockSize;
+	std::size_t bufferCount;
+	/// The block being filled by the module thread.
+	std::string current;
+	std::uint64_t bundleNumber;
+	std::uint64_t firstInBlock;
+
+	std::mutex queueMutex;
+	std::condition_variable queueCv;
+	std::deque<Block> queue;
+	std::vector<std::string> freeBuffers;
+	bool stopping;
+	/// Set by the writer thread when a write fails.
+	std::atomic<bool> writeFailed;
+	std::thread writer;
+
+	// owned by the writer thread until it is joined.
+	std::ofstream file;
+	std::uint64_t fileOffset;
+	std::vector<BundleFileFormat::IndexEntry> indexEntries;
+};
+
+} // namespace pipe
+
+#endif
@@ -0,0 +1,104 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2014 John Sparger <jsparger87@gmail.com>
+//
+// Distributed under the Boost Software License, Version 1.0
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// See https://github.com/jsparger/pipe for more information.
+//---------------------------------------------------------------------------//
+
+#ifndef PIPE_BUNDLE_TAP_HH
+#define PIPE_BUNDLE_TAP_HH
+
+#include "pipe/MessageBundle.hh"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace pipe {
+
+/// \class BundleTap
+/// \brief Publishes a sample of the bundles passing through a connection to a monitoring thread.
+///
+/// A BundleTap is attached to the connection leaving a module with Module::setTap(). The module offers every bundle it pushes to the tap, and the tap keeps a copy of every Nth bundle, at most a given number of times per second. The copy goes into a single slot which the monitoring thread empties with take(). If the monitor is slower than the pipeline, the sample waiting in the slot is replaced by the newer one, so the monitor always sees the latest data and the module never waits for it.
+///
+/// offer() must only be called from one thread (the thread of the tapped module). take() may be called from any one other thread. Both are lock-free. Note that taking a sample copies the bundle, so keep the sampling sparse for bundles with large messages. Lazy messages are shared with the copy and will be computed on the monitoring thread if it reads them first.
+class BundleTap
+{
+public:
+	/// Constructor. A sample is taken from every \p everyNth bundle, but no more than \p maxPerSecond times per second. A \p maxPerSecond of zero means no rate limit.
+	BundleTap(std::uint64_t everyNth = 1, double maxPerSecond = 0)
+		: 	nth(everyNth ? everyNth : 1), slot(nullptr), offered(0), published(0), overwritten(0)
+	{
+		if (maxPerSecond > 0)
+		{
+			period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / maxPerSecond));
+		}
+		else
+		{
+			period = Clock::duration::zero();
+		}
+		nextAllowed = Clock::now();
+	}
+
+	/// Destructor.
+	virtual ~BundleTap()
+	{
+		delete slot.exchange(nullptr);
+	}
+
+	BundleTap(const BundleTap&) = delete;
+	BundleTap& operator=(const BundleTap&) = delete;
+
+	/// Called by the tapped module for every bundle it pushes. Copies \p b into the slot if it is selected by the sampling rules.
+	virtual void offer(const MessageBundle& b)
+	{
+		std::uint64_t count = ++offered;
+		if (0 != count % nth) { return; }
+
+		if (Clock::duration::zero() != period)
+		{
+			Clock::time_point now = Clock::now();
+			if (now < nextAllowed) { return; }
+			nextAllowed = now + period;
+		}
+
+		MessageBundle* stale = slot.exchange(new MessageBundle(b));
+		++published;
+		if (stale)
+		{
+			++overwritten;
+			delete stale;
+		}
+	}
+
+	/// Take the latest sample. Returns an empty pointer if no new sample has been published since the last call. Never blocks.
+	std::unique_ptr<MessageBundle> take()
+	{
+		return std::unique_ptr<MessageBundle>(slot.exchange(nullptr));
+	}
+
+	/// The number of bundles offered to the tap.
+	std::uint64_t offeredCount() const { return offered.load(); }
+
+	/// The number of samples published to the slot.
+	std::uint64_t publishedCount() const { return published.load(); }
+
+	/// The number of samples replaced before the monitor took them.
+	std::uint64_t overwrittenCount() const { return overwritten.load(); }
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	std::uint64_t nth;
+	Clock::duration period;
+	Clock::time_point nextAllowed;
+	std::atomic<MessageBundle*> slot;
+	std::atomic<std::uint64_t> offered, published, overwritten;
+};
+
+} // namespace pipe
+
+#endif
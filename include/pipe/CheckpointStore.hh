@@ -0,0 +1,194 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2014 John Sparger <jsparger87@gmail.com>
+//
+// Distributed under the Boost Software License, Version 1.0
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// See https://github.com/jsparger/pipe for more information.
+//---------------------------------------------------------------------------//
+
+#ifndef PIPE_CHECKPOINT_STORE_HH
+#define PIPE_CHECKPOINT_STORE_HH
+
+#include "pipe/BinaryIO.hh"
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace pipe {
+
+/// \class CheckpointStore
+/// \brief Keeps the latest saved state of each module in a directory, writing in the background.
+///
+/// Modules opt in to checkpointing by overriding Module::checkpointKey(), Module::saveState() and Module::loadState(). A module serializes its state on its own thread at every SOFT_RESET and hands the bytes to save(), which returns immediately. A background thread writes each state to "<directory>/<key>.ckpt", through a temporary file and a rename, so a crash never leaves a half written checkpoint behind. If a module saves again before its previous state was written, only the newer state is written.
+///
+/// A checkpoint file is "PCKP", u32 version, the key, u64 sequence number, the state, and a u32 checksum of everything before it (see BinaryIO). The directory must already exist.
+class CheckpointStore
+{
+public:
+	/// Constructor. Keeps checkpoints in \p directory.
+	CheckpointStore(const std::string& directory)
+		: 	directory(directory), sequence(0), busy(false), stopping(false)
+	{
+		writer = std::thread(&CheckpointStore::writeCheckpoints, this);
+	}
+
+	/// Destructor. Writes any checkpoints still waiting.
+	virtual ~CheckpointStore()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		cv.notify_all();
+		writer.join();
+	}
+
+	CheckpointStore(const CheckpointStore&) = delete;
+	CheckpointStore& operator=(const CheckpointStore&) = delete;
+
+	/// Queue \p state to be written as the latest checkpoint for \p key. Threadsafe, does not wait for the write.
+	virtual void save(const std::string& key, std::string state)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending[key] = std::move(state);
+		}
+		cv.notify_all();
+	}
+
+	/// Read the latest checkpoint for \p key into \p state. Returns false if there is no valid checkpoint. Threadsafe.
+	virtual bool load(const std::string& key, std::string& state)
+	{
+		{
+			// a checkpoint still waiting to be written is the latest one.
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = pending.find(key);
+			if (pending.end() != it)
+			{
+				state = it->second;
+				return true;
+			}
+		}
+
+		std::ifstream file(pathFor(key).c_str(), std::ios::binary);
+		if (!file) { return false; }
+		std::ostringstream contents;
+		contents << file.rdbuf();
+		std::string data = contents.str();
+
+		try
+		{
+			if (data.size() < 12 || data.compare(0, 4, "PCKP") != 0) { throw std::runtime_error("bad header"); }
+			std::size_t body = data.size() - 4;
+			if (BinaryIO::Checksum(data.data(), body) != BinaryIO::Get32(&data[body])) { throw std::runtime_error("checksum mismatch"); }
+
+			BinaryReader in(data);
+			in.get32();
+			if (in.get32() != Version) { throw std::runtime_error("unknown version"); }
+			if (in.getString() != key) { throw std::runtime_error("key mismatch"); }
+			in.get64();
+			state = in.getString();
+		}
+		catch (std::runtime_error& e)
+		{
+			// TODO: throw a real error.
+			std::cerr << "CheckpointStore::load(...): Ignoring checkpoint for " << key << ": " << e.what() << "\n";
+			return false;
+		}
+		return true;
+	}
+
+	/// Wait until every queued checkpoint has been written.
+	virtual void flush()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [this]{ return this->pending.empty() && false == this->busy; });
+	}
+
+	/// The file holding the checkpoint for \p key.
+	std::string pathFor(const std::string& key) const
+	{
+		return directory + "/" + key + ".ckpt";
+	}
+
+private:
+	static const std::uint32_t Version = 1;
+
+	/// The body of the background writer thread.
+	void writeCheckpoints()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			cv.wait(lock, [this]{ return this->stopping || false == this->pending.empty(); });
+			if (pending.empty()) { return; }
+
+			std::string key = pending.begin()->first;
+			std::string state = std::move(pending.begin()->second);
+			pending.erase(pending.begin());
+			busy = true;
+			lock.unlock();
+
+			write(key, state);
+
+			lock.lock();
+			busy = false;
+			cv.notify_all();
+		}
+	}
+
+	/// Write one checkpoint file. Only called from the writer thread.
+	void write(const std::string& key, const std::string& state)
+	{
+		std::string data("PCKP");
+		BinaryIO::Put32(data, Version);
+		BinaryIO::PutString(data, key);
+		BinaryIO::Put64(data, ++sequence);
+		BinaryIO::PutString(data, state);
+		BinaryIO::Put32(data, BinaryIO::Checksum(data.data(), data.size()));
+
+		std::string path = pathFor(key);
+		std::string temp = path + ".tmp";
+		{
+			std::ofstream file(temp.c_str(), std::ios::binary | std::ios::trunc);
+			file.write(data.data(), data.size());
+			if (!file)
+			{
+				// TODO: throw a real error.
+				std::cerr << "CheckpointStore::write(...): Error! Cannot write " << temp << "\n";
+				return;
+			}
+		}
+
+		if (0 != std::rename(temp.c_str(), path.c_str()))
+		{
+			// some platforms will not rename over an existing file.
+			std::remove(path.c_str());
+			if (0 != std::rename(temp.c_str(), path.c_str()))
+			{
+				std::cerr << "CheckpointStore::write(...): Error! Cannot replace " << path << "\n";
+			}
+		}
+	}
+
+	std::string directory;
+	std::uint64_t sequence;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::map<std::string, std::string> pending;
+	bool busy;
+	bool stopping;
+	std::thread writer;
+};
+
+} // namespace pipe
+
+#endif
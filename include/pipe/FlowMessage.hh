@@ -0,0 +1,57 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2014 John Sparger <jsparger87@gmail.com>
+//
+// Distributed under the Boost Software License, Version 1.0
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// See https://github.com/jsparger/pipe for more information.
+//---------------------------------------------------------------------------//
+
+#ifndef PIPE_FLOW_MESSAGE_HH
+#define PIPE_FLOW_MESSAGE_HH
+
+#include "pipe/Message.hh"
+#include <string>
+
+namespace pipe {
+
+/// \class FlowMessage
+/// \brief A Message used to keep track of bundles when a module changes the bundle rate.
+///
+/// The Pipeline starts one cycle at a time and waits for the bundle to come back before starting the next. A MultiModule may turn one bundle into several, or into none, so it marks the bundles it emits with a FlowMessage. A continuation bundle is not the last bundle of its cycle, so the Pipeline does not start a new cycle when it sees one. A bubble carries no data and only exists to finish a cycle (and deliver control messages) when a module emitted nothing; modules skip processData() for bubbles. A FlowMessage is set by MultiModule and should not be set by user modules.
+
+struct FlowMessage : public Message
+{
+	/// Constructor. Takes the \p continuation and \p bubble flags, which default to false.
+	FlowMessage(bool continuation = false, bool bubble = false)
+		: 	continuation(continuation), bubble(bubble)
+	{
+		// do nothing else
+	}
+
+	/// Destructor.
+	virtual ~FlowMessage() {;}
+
+	/// An override from message which will print out details of the message.
+	virtual void serialize(std::ostream& os) const override
+	{
+		os << GetMessageType() << ": continuation = " << continuation << ", bubble = " << bubble;
+	}
+
+	/// A static method allowing this class to be used by BundleAccess. Provides the type of message.
+	static const std::string& GetMessageType()
+	{
+		static std::string MessageType = "pipe::FlowMessage";
+		return MessageType;
+	}
+
+	/// More bundles from the same cycle will follow this one.
+	bool continuation;
+	/// The bundle carries no data.
+	bool bubble;
+};
+
+} // namespace pipe
+
+#endif
@@ -0,0 +1,60 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2014 John Sparger <jsparger87@gmail.com>
+//
+// Distributed under the Boost Software License, Version 1.0
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// See https://github.com/jsparger/pipe for more information.
+//---------------------------------------------------------------------------//
+
+#ifndef PIPE_LAZY_MESSAGE_HH
+#define PIPE_LAZY_MESSAGE_HH
+
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace pipe {
+
+/// \class LazyMessage
+/// \brief A message of type \p T which is computed the first time it is read.
+///
+/// A LazyMessage holds a producer function instead of a value. It is attached to a MessageBundle with BundleAccess::attachLazy() or BundleAccessByName::attachLazy(), and the accessors run the producer the first time the message is read. The result is cached, so the producer runs at most once no matter how many modules (or threads) read the message. Checking for the message with hasMessage() or checkFor() does not run the producer.
+///
+/// The bundle stores a std::shared_ptr to the LazyMessage because std::once_flag cannot be copied.
+template <class T>
+class LazyMessage
+{
+public:
+	/// The type of function used to compute the message.
+	typedef std::function<T()> Producer;
+
+	/// Constructor. Takes the function \p p which will compute the message on first access.
+	LazyMessage(Producer p)
+		: 	producer(std::move(p))
+	{
+		// do nothing else
+	}
+
+	/// Get the message, computing it if this is the first access. Threadsafe.
+	const T& get()
+	{
+		std::call_once(computed, [this]
+		{
+			value.reset(new T(producer()));
+			// the producer may hold on to large upstream data. Let it go.
+			producer = nullptr;
+		});
+		return *value;
+	}
+
+private:
+	Producer producer;
+	std::once_flag computed;
+	std::unique_ptr<T> value;
+};
+
+} // namespace pipe
+
+#endif
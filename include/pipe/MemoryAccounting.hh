@@ -0,0 +1,269 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2014 John Sparger <jsparger87@gmail.com>
+//
+// Distributed under the Boost Software License, Version 1.0
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// See https://github.com/jsparger/pipe for more information.
+//---------------------------------------------------------------------------//
+
+#ifndef PIPE_MEMORY_ACCOUNTING_HH
+#define PIPE_MEMORY_ACCOUNTING_HH
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+namespace pipe {
+
+/// \class MessageSize
+/// \brief Tells MemoryAccounting how many bytes a message of type \p T holds.
+///
+/// If \p T has a byteSize() member function it is used, otherwise sizeof(T). Give messages which own heap memory (vectors of samples, for example) a byteSize() member, or specialize this class.
+template <class T>
+class MessageSize
+{
+	template <class U> static auto check(const U* u) -> decltype(u->byteSize(), std::true_type());
+	template <class U> static std::false_type check(...);
+
+	static std::size_t of(const T& m, std::true_type) { return m.byteSize(); }
+	static std::size_t of(const T&, std::false_type) { return sizeof(T); }
+
+public:
+	/// The number of bytes held by \p m.
+	static std::size_t Of(const T& m)
+	{
+		return of(m, decltype(check<T>(nullptr))());
+	}
+};
+
+/// \class MemoryAccounting
+/// \brief Optional, process wide accounting of the memory held by bundles.
+///
+/// When enabled, every message attached with BundleAccess or BundleAccessByName is counted under its message key until it is detached or its bundle is destroyed. Live bundles are counted too, and high-water marks are kept for everything. Other parts of pipe which hold data on the side (such as the block buffers of BundleFileSink) report under their own keys. Each Module also records how much its processData() changes the count (see ModuleMemoryMeter).
+///
+/// A soft limit can be set on the total. While the total is over the limit the Pipeline holds back new bundles for a while, which lets background consumers catch up before the process runs out of memory.
+///
+/// Accounting is off by default. When it is off the cost is one relaxed atomic load per bundle and per message attached. Enable it before the pipeline starts so the counts are complete.
+class MemoryAccounting
+{
+public:
+	/// Counts for one message key.
+	struct KeyStats
+	{
+		KeyStats() : liveBytes(0), peakBytes(0), attached(0) {;}
+		std::int64_t liveBytes;
+		std::int64_t peakBytes;
+		/// Messages attached with BundleAccess or BundleAccessByName. Bundle copies and other AddBytes() calls are not counted.
+		std::uint64_t attached;
+	};
+
+	/// Turn accounting on or off.
+	static void Enable(bool on = true) { state().enabled.store(on, std::memory_order_relaxed); }
+
+	/// Check whether accounting is on.
+	static bool IsEnabled() { return state().enabled.load(std::memory_order_relaxed); }
+
+	/// Set the soft limit on LiveBytes(). Zero (the default) means no limit.
+	static void SetSoftLimit(std::size_t bytes) { state().softLimit.store(bytes); }
+
+	/// The soft limit on LiveBytes().
+	static std::size_t SoftLimit() { return state().softLimit.load(); }
+
+	/// Check whether LiveBytes() is over the soft limit.
+	static bool OverSoftLimit()
+	{
+		std::size_t limit = SoftLimit();
+		return limit && LiveBytes() > static_cast<std::int64_t>(limit);
+	}
+
+	/// Wait until LiveBytes() is back under the soft limit, but no longer than \p timeout. Returns true if it is under the limit.
+	static bool WaitBelowSoftLimit(std::chrono::milliseconds timeout)
+	{
+		if (false == OverSoftLimit()) { return true; }
+		++state().throttles;
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+		while (OverSoftLimit())
+		{
+			if (std::chrono::steady_clock::now() >= deadline) { return false; }
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+
+	/// Bytes currently accounted for.
+	static std::int64_t LiveBytes() { return state().liveBytes.load(); }
+
+	/// The largest value LiveBytes() has reached.
+	static std::int64_t PeakBytes() { return state().peakBytes.load(); }
+
+	/// Bundles currently alive.
+	static std::int64_t LiveBundles() { return state().liveBundles.load(); }
+
+	/// The largest value LiveBundles() has reached.
+	static std::int64_t PeakBundles() { return state().peakBundles.load(); }
+
+	/// The number of times WaitBelowSoftLimit() had to wait.
+	static std::uint64_t Throttles() { return state().throttles.load(); }
+
+	/// A snapshot of the counts for every message key.
+	static std::map<std::string, KeyStats> ByKey()
+	{
+		std::lock_guard<std::mutex> lock(state().mutex);
+		return state().keys;
+	}
+
+	/// Net bytes added minus removed by the calling thread. Used to measure what a module's processData() holds on to.
+	static std::int64_t ThreadBytes() { return threadBytes(); }
+
+	/// Count \p bytes as held under \p key.
+	static void AddBytes(const std::string& key, std::size_t bytes)
+	{
+		add(key, bytes, false);
+	}
+
+	/// Count a message of \p bytes newly attached to a bundle under \p key. Like AddBytes(), but also counts the attachment.
+	static void AddAttached(const std::string& key, std::size_t bytes)
+	{
+		add(key, bytes, true);
+	}
+
+	/// Stop counting \p bytes under \p key.
+	static void RemoveBytes(const std::string& key, std::size_t bytes)
+	{
+		State& s = state();
+		std::int64_t n = static_cast<std::int64_t>(bytes);
+		s.liveBytes -= n;
+		threadBytes() -= n;
+
+		std::lock_guard<std::mutex> lock(s.mutex);
+		s.keys[key].liveBytes -= n;
+	}
+
+	/// Count a new bundle.
+	static void AddBundle()
+	{
+		State& s = state();
+		raise(s.peakBundles, ++s.liveBundles);
+	}
+
+	/// Stop counting a bundle.
+	static void RemoveBundle()
+	{
+		--state().liveBundles;
+	}
+
+private:
+	struct State
+	{
+		State()
+			: 	enabled(false), softLimit(0), liveBytes(0), peakBytes(0),
+				liveBundles(0), peakBundles(0), throttles(0)
+		{
+			// do nothing else
+		}
+
+		std::atomic<bool> enabled;
+		std::atomic<std::size_t> softLimit;
+		std::atomic<std::int64_t> liveBytes, peakBytes;
+		std::atomic<std::int64_t> liveBundles, peakBundles;
+		std::atomic<std::uint64_t> throttles;
+		std::mutex mutex;
+		std::map<std::string, KeyStats> keys;
+	};
+
+	static void add(const std::string& key, std::size_t bytes, bool attached)
+	{
+		State& s = state();
+		std::int64_t n = static_cast<std::int64_t>(bytes);
+		raise(s.peakBytes, s.liveBytes += n);
+		threadBytes() += n;
+
+		std::lock_guard<std::mutex> lock(s.mutex);
+		KeyStats& k = s.keys[key];
+		k.liveBytes += n;
+		k.peakBytes = std::max(k.peakBytes, k.liveBytes);
+		if (attached) { ++k.attached; }
+	}
+
+	static State& state()
+	{
+		static State s;
+		return s;
+	}
+
+	static std::int64_t& threadBytes()
+	{
+		static thread_local std::int64_t bytes = 0;
+		return bytes;
+	}
+
+	static void raise(std::atomic<std::int64_t>& peak, std::int64_t now)
+	{
+		std::int64_t old = peak.load();
+		while (now > old && !peak.compare_exchange_weak(old, now)) {;}
+	}
+};
+
+/// \class ModuleMemoryMeter
+/// \brief Records how much accounted memory a module's processData() adds or releases.
+///
+/// The meter is written by the module's thread and may be read from any thread.
+class ModuleMemoryMeter
+{
+public:
+	/// A snapshot of the meter.
+	struct Stats
+	{
+		/// The change during the last processData().
+		std::int64_t lastDelta;
+		/// The largest change during a single processData().
+		std::int64_t largestDelta;
+		/// The sum of all changes.
+		std::int64_t netBytes;
+		/// The number of processData() calls measured.
+		std::uint64_t cycles;
+	};
+
+	ModuleMemoryMeter()
+		: 	lastDelta(0), largestDelta(0), netBytes(0), cycles(0)
+	{
+		// do nothing else
+	}
+
+	/// Record a change of \p delta bytes.
+	void record(std::int64_t delta)
+	{
+		lastDelta.store(delta, std::memory_order_relaxed);
+		if (delta > largestDelta.load(std::memory_order_relaxed)) { largestDelta.store(delta, std::memory_order_relaxed); }
+		netBytes.fetch_add(delta, std::memory_order_relaxed);
+		cycles.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/// Read the meter.
+	Stats snapshot() const
+	{
+		Stats s;
+		s.lastDelta = lastDelta.load(std::memory_order_relaxed);
+		s.largestDelta = largestDelta.load(std::memory_order_relaxed);
+		s.netBytes = netBytes.load(std::memory_order_relaxed);
+		s.cycles = cycles.load(std::memory_order_relaxed);
+		return s;
+	}
+
+private:
+	std::atomic<std::int64_t> lastDelta, largestDelta, netBytes;
+	std::atomic<std::uint64_t> cycles;
+};
+
+} // namespace pipe
+
+#endif
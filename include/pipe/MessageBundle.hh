@@ -11,8 +11,13 @@
 #ifndef PIPE_MESSAGE_BUNDLE_HH
 #define PIPE_MESSAGE_BUNDLE_HH
 
+#include "pipe/LazyMessage.hh"
+#include "pipe/MemoryAccounting.hh"
 #include <map>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 //https://github.com/mnmlstc/core
 #include <core/any.hpp>
 
@@ -26,14 +31,69 @@ namespace pipe {
 class MessageBundle
 {
 public:
-	MessageBundle() {;}
+	MessageBundle()
+		: 	counted(MemoryAccounting::IsEnabled())
+	{
+		if (counted) { MemoryAccounting::AddBundle(); }
+	}
+	
+	/// Copy constructor. The copy is accounted for separately from \p other.
+	MessageBundle(const MessageBundle& other)
+		: 	map(other.map), counted(MemoryAccounting::IsEnabled())
+	{
+		if (counted) { MemoryAccounting::AddBundle(); }
+		copyAccounting(other);
+	}
+	
+	/// Copy assignment. Releases what this bundle was accounted for and takes on a copy of \p other's accounting.
+	MessageBundle& operator=(const MessageBundle& other)
+	{
+		if (this == &other) { return *this; }
+		releaseAccounting();
+		map = other.map;
+		copyAccounting(other);
+		return *this;
+	}
+	
+	/// Destructor. Releases the bundle's memory accounting.
+	~MessageBundle()
+	{
+		releaseAccounting();
+		if (counted) { MemoryAccounting::RemoveBundle(); }
+	}
+	
 	typedef std::map<std::string,core::any> MessageMap;
 	
+	/// The number of bytes held by the bundle's messages, as counted by MemoryAccounting. Always 0 when accounting is off.
+	std::size_t accountedBytes() const
+	{
+		std::size_t total = 0;
+		for (auto& entry : accounted) { total += entry.second; }
+		return total;
+	}
+	
 private:
 	/// A type erased map for storing data.
 	MessageMap map;
+	/// Bytes counted with MemoryAccounting for each message key.
+	std::vector<std::pair<std::string,std::size_t>> accounted;
+	/// Whether this bundle is included in MemoryAccounting::LiveBundles().
+	bool counted;
 	friend class Accessor;
 	
+	void copyAccounting(const MessageBundle& other)
+	{
+		if (false == MemoryAccounting::IsEnabled()) { return; }
+		accounted = other.accounted;
+		for (auto& entry : accounted) { MemoryAccounting::AddBytes(entry.first, entry.second); }
+	}
+	
+	void releaseAccounting()
+	{
+		for (auto& entry : accounted) { MemoryAccounting::RemoveBytes(entry.first, entry.second); }
+		accounted.clear();
+	}
+	
 public:
 	
 	/// \class Accessor
@@ -51,6 +111,41 @@ public:
 		{
 			return b.map;
 		}
+		
+		/// Count \p bytes under \p key for bundle \p b, if memory accounting is on.
+		virtual void account(MessageBundle& b, const std::string& key, std::size_t bytes) final
+		{
+			if (false == MemoryAccounting::IsEnabled()) { return; }
+			b.accounted.push_back(std::make_pair(key, bytes));
+			MemoryAccounting::AddAttached(key, bytes);
+		}
+		
+		/// Release the bytes counted under \p key for bundle \p b.
+		virtual void unaccount(MessageBundle& b, const std::string& key) final
+		{
+			for (auto it = b.accounted.begin(); it != b.accounted.end(); ++it)
+			{
+				if (it->first != key) { continue; }
+				MemoryAccounting::RemoveBytes(it->first, it->second);
+				b.accounted.erase(it);
+				return;
+			}
+		}
+		
+		/// Get a pointer to the message of type \p T held in \p wrapped. If the message is a LazyMessage it is computed now (once). If it is a shared payload, the shared data is returned. Returns a null pointer if \p wrapped does not hold a message of type \p T.
+		template <class T>
+		const T* unwrap(core::any& wrapped)
+		{
+			if (T* message = core::any_cast<T>(&wrapped)) { return message; }
+			
+			auto shared = core::any_cast<std::shared_ptr<const T>>(&wrapped);
+			if (shared) { return shared->get(); }
+			
+			auto lazy = core::any_cast<std::shared_ptr<LazyMessage<T>>>(&wrapped);
+			if (lazy) { return &(*lazy)->get(); }
+			
+			return nullptr;
+		}
 	};
 };
 
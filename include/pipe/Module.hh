@@ -16,9 +16,14 @@
 
 #include "pipe/MessageBundle.hh"
 #include "pipe/ControlMessage.hh"
+#include "pipe/FlowMessage.hh"
+#include "pipe/Interrupt.hh"
 #include "pipe/BundleAccess.hh"
+#include "pipe/BundleTap.hh"
+#include "pipe/CheckpointStore.hh"
 #include <memory>
 #include <condition_variable>
+#include <exception>
 #include <mutex>
 
 namespace pipe {
@@ -33,7 +38,7 @@ class Module
 public:
 	/// Constructor. Initializes module to safe state.
 	Module()
-		: 	next(0), newDataReady(false), isAlive(true), waitLock(waitMutex), 
+		: 	next(0), outputTap(0), checkpoints(0), restoreOnStart(false), newDataReady(false), isAlive(true), waitLock(waitMutex), 
 			dataLock(dataMutex), bundle(new MessageBundle)
 	{
 		// initial state is:
@@ -92,21 +97,59 @@ public:
 		return module;	
 	}
 	
-	/// Starts the module's operation. If \p persist is false the module will only process one cycle
+	/// Attaches \p tap to the connection leaving this module. Every bundle this module pushes, except empty bubbles, will be offered to the tap. Call before the module is started.
+	virtual void setTap(BundleTap& tap)
+	{
+		outputTap = &tap;
+	}
+	
+	/// Use \p store to checkpoint this module's state at every SOFT_RESET. If \p restore is true, the module's state is restored from its latest checkpoint when it starts. Has no effect unless the module overrides checkpointKey(). Call before the module is started. Calling this on a Pipeline applies it to every module in the pipeline which does not have a store of its own.
+	virtual void setCheckpointStore(CheckpointStore& store, bool restore = true)
+	{
+		checkpoints = &store;
+		restoreOnStart = restore;
+	}
+	
+	/// The checkpoint store set with setCheckpointStore(), or a null pointer.
+	virtual CheckpointStore* getCheckpointStore() const
+	{
+		return checkpoints;
+	}
+	
+	/// How much accounted memory this module's processData() has added or released. Only measured while MemoryAccounting is enabled. Threadsafe.
+	virtual ModuleMemoryMeter::Stats getMemoryStats() const
+	{
+		return memoryMeter.snapshot();
+	}
+	
+	/// The first exception thrown by one of this module's hooks during its last run, or a null pointer. Read it after the module's thread has been joined.
+	virtual std::exception_ptr getFailure() const
+	{
+		return failure;
+	}
+	
+	/// Starts the module's operation. If \p persist is false the module will only process one cycle. An exception thrown by a hook does not escape the module's thread: it is kept for getFailure(), processData() is no longer called, and a FINISHED interrupt is attached to every bundle pushed so the pipeline shuts down.
 	virtual void operator()(bool persist = true)
 	{	
-		initialize();
+		failure = nullptr;
+		guarded([this]{ this->initialize(); this->restoreCheckpoint(); });
 	
 		do
 		{
 			waitForData();
 			processControlMessage();
-			processData();
+			if (!failure && false == isBubble())
+			{
+				guarded([this]{ this->measuredProcessData(); });
+			}
 			pushData();		
 		
 		} while (persist && isAlive);
 	
-		cleanUp();
+		guarded([this]{ this->cleanUp(); });
+		
+		// an override of cleanUp() which threw may not have reached ours.
+		if (waitLock.owns_lock()) { waitLock.unlock(); }
 	}
 	
 protected:
@@ -131,14 +174,24 @@ protected:
 	
 		if (ControlMessage::Type::SOFT_RESET == m.type)
 		{
-			reset();
+			guarded([this]{ this->reset(); this->checkpoint(); });
 		}
 		else if (ControlMessage::Type::SHUTDOWN == m.type)
 		{
-			shutDown();
+			guarded([this]{ this->shutDown(); });
+			
+			// a shutDown() which threw may not have reached ours.
+			if (failure) { isAlive = false; }
 		}
 	}
 	
+	/// Check whether the current bundle is a bubble (see FlowMessage). Bubbles carry no data, so processData() is not called for them.
+	virtual bool isBubble()
+	{
+		FlowMessage m;
+		return (flowAccess.readFrom(bundle, m) && m.bubble);
+	}
+	
 	/// Called when a shutdown control message is received.
 	virtual void shutDown()
 	{
@@ -149,9 +202,50 @@ protected:
 	/// This member function should be implemented to define the functionality of user modules. This member function is called during every cycle of the module to process the message bundle that was received. The user can use this hook to inspect the message bundle, do work with its contents, and attach new data.
 	virtual void processData() = 0;
 	
+	/// Calls processData(), measuring the change in accounted memory when MemoryAccounting is enabled.
+	virtual void measuredProcessData()
+	{
+		if (false == MemoryAccounting::IsEnabled())
+		{
+			processData();
+			return;
+		}
+		
+		// each module runs on its own thread, so the thread's count only
+		// moves because of what this module does.
+		std::int64_t before = MemoryAccounting::ThreadBytes();
+		processData();
+		memoryMeter.record(MemoryAccounting::ThreadBytes() - before);
+	}
+	
+	/// Runs \p step, keeping the first exception it throws for getFailure() instead of letting it escape the module's thread.
+	template <class Step>
+	void guarded(Step step)
+	{
+		try
+		{
+			step();
+		}
+		catch (...)
+		{
+			if (!failure) { failure = std::current_exception(); }
+		}
+	}
+	
 	/// Pushes data to the next module in the chain and allows new data to be pushed to this module
 	virtual void pushData()
 	{
+		// a failed module asks the pipeline to shut down.
+		if (failure && bundle)
+		{
+			BundleAccess<Interrupt> interruptAccess;
+			interruptAccess.detachFrom(bundle);
+			interruptAccess.attachTo(bundle, Interrupt(Interrupt::Type::FINISHED));
+		}
+		
+		// let the tap (if any) take a sample.
+		offerToTap(bundle);
+		
 		// push the bundle on to the next module in the chain.
 		// contents of bundle are now trash.
 		if (next) { next->push(std::move(bundle)); }
@@ -160,6 +254,15 @@ protected:
 		dataLock.unlock();
 	}
 	
+	/// Offers \p b to the output tap, if there is one. Bubbles carry no data and are not offered, so they cannot take the place of a real sample.
+	void offerToTap(std::unique_ptr<MessageBundle>& b)
+	{
+		if (!outputTap || !b) { return; }
+		FlowMessage flow;
+		if (flowAccess.readFrom(b, flow) && flow.bubble) { return; }
+		outputTap->offer(*b);
+	}
+	
 	/// A hook to perform any post-constructor initialization the module might need.
 	virtual void initialize()
 	{
@@ -180,7 +283,63 @@ protected:
 		// do nothing
 	}
 	
+	/// The name this module's state is checkpointed under. Override this, saveState() and loadState() to make the module checkpointable. The name must be unique within the pipeline and usable as a file name. The default, an empty string, turns checkpointing off.
+	virtual std::string checkpointKey() const
+	{
+		return std::string();
+	}
+	
+	/// Append the module's state to \p state. Use BinaryIO to write values in a portable way. Called on the module's thread after reset() at every SOFT_RESET, so the checkpoint holds the state the module carries into the next segment.
+	virtual void saveState(std::string& /*state*/)
+	{
+		// nothing to save
+	}
+	
+	/// Restore the state written by saveState() from \p in. Called on the module's thread right after initialize(). Return false if the state could not be used; the module then starts from scratch as usual.
+	virtual bool loadState(BinaryReader& /*in*/)
+	{
+		return false;
+	}
+	
+	/// Hands the module's state to the checkpoint store, if checkpointing is enabled.
+	virtual void checkpoint()
+	{
+		if (nullptr == checkpoints) { return; }
+		std::string key = checkpointKey();
+		if (key.empty()) { return; }
+		
+		std::string state;
+		saveState(state);
+		checkpoints->save(key, std::move(state));
+	}
+	
+	/// Restores the module's state from its latest checkpoint, if restoring is enabled and a checkpoint exists.
+	virtual void restoreCheckpoint()
+	{
+		if (nullptr == checkpoints || false == restoreOnStart) { return; }
+		std::string key = checkpointKey();
+		std::string state;
+		if (key.empty() || false == checkpoints->load(key, state)) { return; }
+		
+		BinaryReader in(state);
+		try
+		{
+			if (false == loadState(in))
+			{
+				std::cerr << "Module::restoreCheckpoint(): " << key << " did not accept its checkpoint.\n";
+			}
+		}
+		catch (std::runtime_error& e)
+		{
+			// TODO: throw a real error.
+			std::cerr << "Module::restoreCheckpoint(): Error! Bad checkpoint for " << key << ": " << e.what() << "\n";
+		}
+	}
+	
 	Module* next;
+	BundleTap* outputTap;
+	CheckpointStore* checkpoints;
+	bool restoreOnStart;
 	bool newDataReady;
 	bool isAlive;
 	std::mutex waitMutex, dataMutex;
@@ -189,6 +348,10 @@ protected:
 	/// The message bundle. To be accessed directly by user modules in their processData() implementation.
 	std::unique_ptr<MessageBundle> bundle;
 	BundleAccess<ControlMessage> controlAccess;
+	BundleAccess<FlowMessage> flowAccess;
+	ModuleMemoryMeter memoryMeter;
+	/// The first exception thrown by a hook, see getFailure().
+	std::exception_ptr failure;
 };
 	
 } // namespace pipe
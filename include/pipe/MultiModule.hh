@@ -0,0 +1,179 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2014 John Sparger <jsparger87@gmail.com>
+//
+// Distributed under the Boost Software License, Version 1.0
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// See https://github.com/jsparger/pipe for more information.
+//---------------------------------------------------------------------------//
+
+#ifndef PIPE_MULTI_MODULE_HH
+#define PIPE_MULTI_MODULE_HH
+
+#include "pipe/Module.hh"
+#include "pipe/Interrupt.hh"
+#include <vector>
+
+namespace pipe {
+
+/// \class MultiModule
+/// \brief Abstract base class for modules which emit zero, one or many bundles per bundle received.
+///
+/// A normal Module passes on exactly the bundle it received. A MultiModule instead passes on whatever bundles were given to emit() while processing the current bundle. This allows splitters (one DAQ readout block in, many event bundles out) and aggregators (many small events in, one batch bundle out). Call forward() to pass on the received bundle itself.
+///
+/// MultiModule marks the bundles it emits with FlowMessages so that the Pipeline still knows when a cycle is over, and makes sure control messages are not lost or duplicated:
+/// - A ControlMessage on the received bundle is moved to the first bundle emitted after reset() has been called. Bundles emitted from inside reset() (for example, an aggregator flushing a partial batch) therefore reach downstream modules before the control message does. A SHUTDOWN is moved to the last bundle emitted, since downstream modules stop after the bundle which carries it.
+/// - At shutdown, flush() is called after the last bundle has been processed. This is the place for an aggregator to emit its final partial batch. shutDown() is too early, since it runs before processData() sees the last bundle.
+/// - If nothing is emitted for the last bundle of a cycle, or nothing is emitted after a control message, an empty bubble bundle is sent in its place. Downstream modules do not call processData() for bubbles.
+/// - An Interrupt on the received bundle is moved to the last bundle emitted for it, so it is not lost when the received bundle is dropped. Interrupts attached to any emitted bundle reach the Pipeline.
+class MultiModule : public Module
+{
+public:
+	/// Constructor.
+	MultiModule()
+		: 	inputContinued(false), inputBubble(false), hasControl(false), controlIndex(0), hasInterrupt(false)
+	{
+		// do nothing else
+	}
+
+	/// Destructor
+	virtual ~MultiModule() {;}
+
+protected:
+
+	/// Queue \p b to be pushed to the next module once the current bundle is done.
+	virtual void emit(std::unique_ptr<MessageBundle> b)
+	{
+		if (b) { emitted.push_back(std::move(b)); }
+	}
+
+	/// Queue the bundle currently being processed to be pushed to the next module. After this call the member "bundle" is empty.
+	virtual void forward()
+	{
+		emit(std::move(bundle));
+	}
+
+	/// Dispatches control messages as Module does, then takes the control and flow messages off the received bundle so they can be placed on the emitted bundles.
+	virtual void processControlMessage() override
+	{
+		Module::processControlMessage();
+
+		// anything emitted by reset() or shutDown() goes ahead of the control message.
+		controlIndex = emitted.size();
+		hasControl = controlAccess.readFrom(bundle, control);
+		if (hasControl) { controlAccess.detachFrom(bundle); }
+
+		hasInterrupt = interruptAccess.readFrom(bundle, interrupt);
+		if (hasInterrupt) { interruptAccess.detachFrom(bundle); }
+
+		FlowMessage flow;
+		bool hasFlow = flowAccess.readFrom(bundle, flow);
+		inputContinued = hasFlow && flow.continuation;
+		inputBubble = hasFlow && flow.bubble;
+		flowAccess.detachFrom(bundle);
+	}
+	
+	/// The flow message has already been taken off the received bundle, so use what processControlMessage() found.
+	virtual bool isBubble() override
+	{
+		return inputBubble;
+	}
+
+	/// A hook which is called at shutdown, after the last bundle has been processed (or skipped, if it was a bubble). Emit anything the module is still holding. The SHUTDOWN is placed after whatever is emitted here.
+	virtual void flush()
+	{
+		// do nothing
+	}
+
+	/// Pushes every emitted bundle to the next module in the chain and allows new data to be pushed to this module.
+	virtual void pushData() override
+	{
+		if (false == isAlive && !failure) { guarded([this]{ this->flush(); }); }
+
+		// a failed module asks the pipeline to shut down.
+		if (failure)
+		{
+			hasInterrupt = true;
+			interrupt = Interrupt(Interrupt::Type::FINISHED);
+		}
+
+		std::vector<std::unique_ptr<MessageBundle>> out;
+		out.swap(emitted);
+
+		// downstream modules stop after the bundle carrying a shutdown, so
+		// it has to ride on the last one.
+		if (hasControl && ControlMessage::Type::SHUTDOWN == control.type && false == out.empty())
+		{
+			controlIndex = out.size() - 1;
+		}
+
+		// the pipeline is waiting for the last bundle of the cycle, and the
+		// control message must go somewhere. Send a bubble if need be.
+		bool needBubble = (hasControl && controlIndex >= out.size()) || (out.empty() && (false == inputContinued || hasInterrupt));
+		if (needBubble)
+		{
+			out.push_back(std::unique_ptr<MessageBundle>(new MessageBundle));
+			flowAccess.attachTo(out.back(), FlowMessage(false, true));
+		}
+
+		if (hasControl && false == controlAccess.attachTo(out[controlIndex], control))
+		{
+			// TODO: throw error instead
+			std::cerr << "MultiModule::pushData, already a control "
+							"message in bundle somehow!\n";
+		}
+
+		if (hasInterrupt)
+		{
+			// keep a FINISHED already on the bundle over our BREAK_POINT.
+			Interrupt existing;
+			if (false == interruptAccess.readFrom(out.back(), existing) || Interrupt::Type::FINISHED == interrupt.type)
+			{
+				interruptAccess.detachFrom(out.back());
+				interruptAccess.attachTo(out.back(), interrupt);
+			}
+		}
+
+		// every bundle but the last is a continuation. The last one ends the
+		// cycle only if the bundle we received did.
+		for (std::size_t i = 0; i < out.size(); ++i)
+		{
+			FlowMessage flow;
+			bool bubble = (flowAccess.readFrom(out[i], flow) && flow.bubble);
+			bool continuation = (i + 1 < out.size()) || inputContinued;
+			flowAccess.detachFrom(out[i]);
+			if (continuation || bubble)
+			{
+				flowAccess.attachTo(out[i], FlowMessage(continuation, bubble));
+			}
+		}
+
+		hasControl = false;
+		hasInterrupt = false;
+
+		for (auto& b : out)
+		{
+			offerToTap(b);
+			if (next) { next->push(std::move(b)); }
+		}
+
+		// unlock the data
+		dataLock.unlock();
+	}
+
+	/// The bundles emitted while processing the current bundle.
+	std::vector<std::unique_ptr<MessageBundle>> emitted;
+	bool inputContinued;
+	bool inputBubble;
+	bool hasControl;
+	std::size_t controlIndex;
+	ControlMessage control;
+	bool hasInterrupt;
+	Interrupt interrupt;
+	BundleAccess<Interrupt> interruptAccess;
+};
+
+} // namespace pipe
+
+#endif
@@ -14,7 +14,10 @@
 #include <thread>
 #include <vector>
 #include "pipe/Module.hh"
+#include "pipe/Interrupt.hh"
 #include <atomic>
+#include <chrono>
+#include <functional>
 
 namespace pipe {
 
@@ -28,7 +31,7 @@ class Pipeline : public Module
 public:
 	/// Constructor.
 	Pipeline()
-		: 	terminateSignal(false)
+		: 	holdBack(false), hasPendingControl(false), backpressureTimeout(1000), terminateSignal(false)
 	{
 		// we will not be receiving any data on startup.
 		// our empty bundle is good enough though. Lock the dataLock.
@@ -75,7 +78,7 @@ public:
 	// 	return static_cast<Pipeline&>(connect(*ownedModuleVec.back()));
 	// }
 	
-	/// Starts the pipeline's operation. This will launch each module in its own thread and begin this module (Pipeline's) own operational cycle.
+	/// Starts the pipeline's operation. This will launch each module in its own thread and begin this module (Pipeline's) own operational cycle. If a checkpoint store has been set with setCheckpointStore(), each checkpointable module restores its latest state right after its initialize(). If a module throws, the pipeline shuts down and the exception from the first failed module in the chain is rethrown once every module has stopped.
 	virtual void operator()(bool persist = true) override
 	{
 		// Check to see if any modules are attached.
@@ -89,6 +92,18 @@ public:
 		// This forms a ring so we can receive feedback from the modules.
 		moduleVec.back()->connect(*this);
 	
+		// hand our checkpoint store (if any) to modules without their own.
+		if (checkpoints)
+		{
+			for (auto module : moduleVec)
+			{
+				if (nullptr == module->getCheckpointStore())
+				{
+					module->setCheckpointStore(*checkpoints, restoreOnStart);
+				}
+			}
+		}
+	
 		// launch the modules, each in a separate thread.
 		for (auto module : moduleVec)
 		{
@@ -116,7 +131,21 @@ public:
 		for (auto& thread : threadVec)
 		{
 			thread.join();
-		}	
+		}
+		threadVec.clear();
+		
+		// pass on the first failure in the chain.
+		for (auto module : moduleVec)
+		{
+			std::exception_ptr e = module->getFailure();
+			if (e) { std::rethrow_exception(e); }
+		}
+	}
+	
+	/// Set the longest time the pipeline will hold back a new bundle while MemoryAccounting is over its soft limit. The wait is bounded because memory held inside the chain may only be released when more data flows.
+	virtual void setBackpressureTimeout(std::chrono::milliseconds timeout)
+	{
+		backpressureTimeout = timeout;
 	}
 	
 	/// Call this method externally to force a shutdown signal to be sent through the pipeline. This method is threadsafe.
@@ -129,37 +158,64 @@ public:
 	
 protected:
 	
-	/// Provides a new MessageBundle to the pipeline, checks for Interrupt messages, checks for termination, and provides ControlMessages.
+	/// Provides a new MessageBundle to the pipeline, checks for Interrupt messages, checks for termination, and provides ControlMessages. No new bundle is provided while continuation bundles from a MultiModule are still coming back.
 	virtual void processData() override
 	{
 		// we are connected to the last module in the chain, so the
 		// data we receive is an old bundle we generated, though
 		// perhaps now containing interrupts from the modules in the 
-		// pipeline.
-	
+		// pipeline. Interrupts can come back on any bundle of the cycle.
+		processEndOfLine(bundle);
+		
+		// if a MultiModule split our bundle, the cycle is not over until
+		// the last piece comes back. Don't start a new one yet.
+		FlowMessage flow;
+		holdBack = (flowAccess.readFrom(bundle, flow) && flow.continuation);
+		if (holdBack) { return; }
+		
 		// swap a fresh bundle in for the "end of line" bundle we have now.
 		std::unique_ptr<MessageBundle> endOfLine(new MessageBundle);
 		bundle.swap(endOfLine);
+		
+		// the finished cycle's data is released first. What is still counted
+		// is held elsewhere (a sink's write queue, for example), so give it a
+		// chance to drain before we make more work.
+		endOfLine.reset();
+		if (MemoryAccounting::IsEnabled() && false == terminateSignal)
+		{
+			MemoryAccounting::WaitBelowSoftLimit(backpressureTimeout);
+		}
 	
-		// inspect the end of line bundle and take action if need be.
 		if (terminateSignal)
 		{
-			BundleAccess<ControlMessage> controlAccess;
-			ControlMessage cm(ControlMessage::Type::SHUTDOWN);
-			if(false == controlAccess.attachTo(bundle, cm))
-			{
-				// TODO: throw error instead	
-				std::cerr << "Pipeline::processData, already a control " 
-								"message in bundle somehow!\n";
-			}
+			pendingControl.type = ControlMessage::Type::SHUTDOWN;
+			hasPendingControl = true;
 		}
-		else
+		
+		if (false == hasPendingControl) { return; }
+		
+		hasPendingControl = false;
+		if(false == controlAccess.attachTo(bundle, pendingControl))
 		{
-			processEndOfLine(endOfLine);
+			// TODO: throw error instead	
+			std::cerr << "Pipeline::processData, already a control " 
+							"message in bundle somehow!\n";
 		}
 	}
 	
-	///  Helper function that hecks for Interrupts and writes the corresponding ControlMessage to the MessageBundle.
+	/// Pushes the fresh bundle to the first module, unless the cycle is still in progress.
+	virtual void pushData() override
+	{
+		if (holdBack)
+		{
+			// the bundle we have is trash. Just accept the next one.
+			dataLock.unlock();
+			return;
+		}
+		Module::pushData();
+	}
+	
+	///  Helper function that checks for Interrupts and remembers the corresponding ControlMessage, which is written to the next fresh MessageBundle. A SHUTDOWN takes precedence over a SOFT_RESET if several interrupts arrive in one cycle.
 	virtual void processEndOfLine(std::unique_ptr<MessageBundle>& eol)
 	{
 		// check for an interrupt
@@ -172,7 +228,6 @@ protected:
 	
 		// TODO: This should atually evaluate the Interrupt
 		// if we found one, treat it as shutdown for now.
-		BundleAccess<ControlMessage> controlAccess;
 		ControlMessage cm;
 	
 		if (Interrupt::Type::BREAK_POINT == interrupt.type)
@@ -183,18 +238,22 @@ protected:
 		{
 			cm.type = ControlMessage::Type::SHUTDOWN;
 		}
-	
-		if(false == controlAccess.attachTo(bundle, cm))
+		
+		if (hasPendingControl && ControlMessage::Type::SHUTDOWN == pendingControl.type)
 		{
-			// TODO: throw error instead
-			std::cerr << "Pipeline::processEndOfLine, already a control " 
-							"message in bundle somehow!\n";
+			return;
 		}
+		pendingControl = cm;
+		hasPendingControl = true;
 	}
 	
 	std::vector<Module*> moduleVec;
 	std::vector<std::unique_ptr<Module>> ownedModuleVec;
 	std::vector<std::thread> threadVec;
+	bool holdBack;
+	bool hasPendingControl;
+	ControlMessage pendingControl;
+	std::chrono::milliseconds backpressureTimeout;
 	std::atomic<bool> terminateSignal;
 };
 	
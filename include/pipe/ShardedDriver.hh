@@ -0,0 +1,126 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2014 John Sparger <jsparger87@gmail.com>
+//
+// Distributed under the Boost Software License, Version 1.0
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// See https://github.com/jsparger/pipe for more information.
+//---------------------------------------------------------------------------//
+
+#ifndef PIPE_SHARDED_DRIVER_HH
+#define PIPE_SHARDED_DRIVER_HH
+
+#include "pipe/Pipeline.hh"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace pipe {
+
+/// \class Shard
+/// \brief One Pipeline, with the modules it runs, built to process one segment of a dataset.
+///
+/// A ShardedDriver asks its factory for a Shard for every segment, runs the shard's pipeline to completion, and then collects the shard's result. A Shard usually owns its modules as members, since Pipeline only holds pointers to them.
+template <class Result>
+class Shard
+{
+public:
+	/// Destructor
+	virtual ~Shard() {;}
+
+	/// The pipeline to run. All of the shard's modules must already be connected to it.
+	virtual Pipeline& getPipeline() = 0;
+
+	/// The result of the segment (histograms, counters, ...). Called after the pipeline has finished.
+	virtual Result result() = 0;
+};
+
+/// \class ShardedDriver
+/// \brief Runs many independent Pipelines over the segments of a dataset and merges their results.
+///
+/// The driver keeps a fixed number of worker threads busy. Each worker takes the next unprocessed segment (a file, or a SOFT_RESET-delimited range of one, or whatever \p Segment describes), builds a Shard for it with the factory, and runs it. Workers take segments one at a time as they finish, so a few large segments cannot leave the other cores idle. If segment costs are known, passing them to run() starts the most expensive segments first, which shortens the tail.
+///
+/// Results are merged in segment order, never in completion order, so the merged result does not depend on scheduling. By default results are merged with a.merge(b); pass a MergeFunction for types without a merge() member.
+template <class Segment, class Result>
+class ShardedDriver
+{
+public:
+	/// Builds the shard which will process a segment.
+	typedef std::function<std::unique_ptr<Shard<Result>>(const Segment&)> Factory;
+	/// Merges the second result into the first.
+	typedef std::function<void(Result&, const Result&)> MergeFunction;
+
+	/// Constructor. Uses \p factory to build a shard per segment and runs up to \p workers shards at once. Zero workers means one per hardware thread.
+	ShardedDriver(Factory factory, unsigned workers = 0, MergeFunction merge = MergeFunction())
+		: 	factory(std::move(factory)), workers(workers), merge(std::move(merge))
+	{
+		if (0 == this->workers) { this->workers = std::max(1u, std::thread::hardware_concurrency()); }
+		if (!this->merge) { this->merge = [](Result& a, const Result& b) { a.merge(b); }; }
+	}
+
+	/// Destructor
+	virtual ~ShardedDriver() {;}
+
+	/// Process every segment and return the merged result. \p costs, if given, holds an estimated cost (such as the file size) per segment and is only used to decide the order in which segments start. If a shard fails, whether its factory, one of its modules (see Pipeline::operator()) or result() throws, the remaining segments are still processed and then the exception from the lowest numbered failed segment is rethrown.
+	virtual Result run(const std::vector<Segment>& segments, const std::vector<double>& costs = std::vector<double>())
+	{
+		std::vector<std::size_t> order(segments.size());
+		for (std::size_t i = 0; i < order.size(); ++i) { order[i] = i; }
+		if (costs.size() == segments.size())
+		{
+			std::stable_sort(order.begin(), order.end(), [&costs](std::size_t a, std::size_t b) { return costs[a] > costs[b]; });
+		}
+
+		std::vector<std::unique_ptr<Result>> results(segments.size());
+		std::vector<std::exception_ptr> errors(segments.size());
+		std::atomic<std::size_t> nextSegment(0);
+
+		auto work = [&]
+		{
+			for (std::size_t k = nextSegment++; k < order.size(); k = nextSegment++)
+			{
+				std::size_t i = order[k];
+				try
+				{
+					std::unique_ptr<Shard<Result>> shard = factory(segments[i]);
+					shard->getPipeline()();
+					results[i].reset(new Result(shard->result()));
+				}
+				catch (...)
+				{
+					errors[i] = std::current_exception();
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		std::size_t count = std::min<std::size_t>(workers, segments.size());
+		for (std::size_t t = 0; t < count; ++t) { threads.push_back(std::thread(work)); }
+		for (auto& thread : threads) { thread.join(); }
+
+		for (auto& error : errors)
+		{
+			if (error) { std::rethrow_exception(error); }
+		}
+
+		// merge in segment order so the answer never depends on which worker finished first.
+		if (results.empty()) { return Result(); }
+		Result merged = *results.front();
+		for (std::size_t i = 1; i < results.size(); ++i) { merge(merged, *results[i]); }
+		return merged;
+	}
+
+protected:
+	Factory factory;
+	unsigned workers;
+	MergeFunction merge;
+};
+
+} // namespace pipe
+
+#endif
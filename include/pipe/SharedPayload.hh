@@ -0,0 +1,149 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2014 John Sparger <jsparger87@gmail.com>
+//
+// Distributed under the Boost Software License, Version 1.0
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// See https://github.com/jsparger/pipe for more information.
+//---------------------------------------------------------------------------//
+
+#ifndef PIPE_SHARED_PAYLOAD_HH
+#define PIPE_SHARED_PAYLOAD_HH
+
+#include "pipe/BundleAccess.hh"
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace pipe {
+
+/// \class SharedPayloadStats
+/// \brief Memory accounting for all SharedPayload versions in the process.
+///
+/// Every version created by a SharedPayload is counted here from the moment it is published until the last bundle (or module) holding it lets it go.
+class SharedPayloadStats
+{
+public:
+	/// The number of bytes held by live payload versions.
+	static std::size_t LiveBytes() { return liveBytes().load(); }
+
+	/// The largest value LiveBytes() has reached.
+	static std::size_t PeakBytes() { return peakBytes().load(); }
+
+	/// The number of live payload versions.
+	static std::size_t LiveVersions() { return liveVersions().load(); }
+
+private:
+	template <class T> friend class SharedPayload;
+
+	static void add(std::size_t bytes)
+	{
+		++liveVersions();
+		std::size_t now = (liveBytes() += bytes);
+		std::size_t peak = peakBytes().load();
+		while (now > peak && !peakBytes().compare_exchange_weak(peak, now)) {;}
+	}
+
+	static void remove(std::size_t bytes)
+	{
+		--liveVersions();
+		liveBytes() -= bytes;
+	}
+
+	static std::atomic<std::size_t>& liveBytes() { static std::atomic<std::size_t> n(0); return n; }
+	static std::atomic<std::size_t>& peakBytes() { static std::atomic<std::size_t> n(0); return n; }
+	static std::atomic<std::size_t>& liveVersions() { static std::atomic<std::size_t> n(0); return n; }
+};
+
+/// \class SharedPayload
+/// \brief An immutable, reference counted piece of data shared by many bundles.
+///
+/// SharedPayload is meant for data like calibration tables, geometry maps and pulse templates which every bundle needs but nobody modifies. Attaching the payload to a bundle only copies a std::shared_ptr, and modules read it with the usual BundleAccess<T>::readFrom() or readRef().
+///
+/// A new version can be published at any time with publish(), or prepared with stage() and swapped in later with commit(). The usual place to call commit() is the reset() hook of the module that attaches the payload, so the new version takes effect at a SOFT_RESET boundary. Each bundle holds the version that was current when it was attached, so a reader never sees a partially updated payload, and old versions are freed when the last bundle using them is destroyed.
+template <class T>
+class SharedPayload
+{
+public:
+	/// A single immutable version of the payload.
+	typedef std::shared_ptr<const T> Version;
+	/// The type of function used to measure a version for memory accounting.
+	typedef std::function<std::size_t(const T&)> SizeFunction;
+
+	/// Constructor. Takes the \p initial payload and an optional function \p sizeOf used to report the payload's memory footprint to SharedPayloadStats. If \p sizeOf is not given, sizeof(T) is used.
+	SharedPayload(T initial, SizeFunction sizeOf = SizeFunction())
+		: 	sizeFunction(std::move(sizeOf)), version(makeVersion(std::move(initial)))
+	{
+		// do nothing else
+	}
+
+	/// Destructor
+	virtual ~SharedPayload() {;}
+
+	/// Get the current version. Threadsafe.
+	Version current() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return version;
+	}
+
+	/// Replace the current version immediately. Threadsafe.
+	void publish(T value)
+	{
+		Version fresh = makeVersion(std::move(value));
+		std::lock_guard<std::mutex> lock(mutex);
+		version.swap(fresh);
+		// the old version (now in fresh) is released outside the lock.
+	}
+
+	/// Prepare a new version which will become current on the next call to commit(). Threadsafe.
+	void stage(T value)
+	{
+		Version fresh = makeVersion(std::move(value));
+		std::lock_guard<std::mutex> lock(mutex);
+		staged.swap(fresh);
+	}
+
+	/// Make the staged version current. Returns false if nothing was staged. Threadsafe.
+	bool commit()
+	{
+		Version old;
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!staged) { return false; }
+		old.swap(version);
+		version.swap(staged);
+		return true;
+	}
+
+	/// Attach the current version to \p bundle. Returns false if a message of type \p T is already attached.
+	bool attachTo(std::unique_ptr<MessageBundle>& bundle) const
+	{
+		BundleAccess<T> access;
+		return access.attachShared(bundle, current());
+	}
+
+private:
+	Version makeVersion(T value) const
+	{
+		std::size_t bytes = sizeFunction ? sizeFunction(value) : sizeof(T);
+		T* payload = new T(std::move(value));
+		SharedPayloadStats::add(bytes);
+		return Version(payload, [bytes](const T* p)
+		{
+			delete p;
+			SharedPayloadStats::remove(bytes);
+		});
+	}
+
+	SizeFunction sizeFunction;
+	mutable std::mutex mutex;
+	Version version;
+	Version staged;
+};
+
+} // namespace pipe
+
+#endif
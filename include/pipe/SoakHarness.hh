@@ -0,0 +1,282 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2014 John Sparger <jsparger87@gmail.com>
+//
+// Distributed under the Boost Software License, Version 1.0
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// See https://github.com/jsparger/pipe for more information.
+//---------------------------------------------------------------------------//
+
+#ifndef PIPE_SOAK_HARNESS_HH
+#define PIPE_SOAK_HARNESS_HH
+
+#include "pipe/Pipeline.hh"
+#include "pipe/SyntheticSource.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <thread>
+
+namespace pipe {
+
+/// \class LatencyHistogram
+/// \brief A fixed size log-linear histogram of latencies in nanoseconds.
+///
+/// Each power of two is split into 16 buckets, so percentiles are accurate to about 6% over the whole range of a 64 bit value. Recording is a single relaxed atomic increment, so one thread can record while another reads.
+class LatencyHistogram
+{
+public:
+	/// Constructor.
+	LatencyHistogram()
+	{
+		for (auto& b : buckets) { b.store(0, std::memory_order_relaxed); }
+	}
+
+	/// Record one latency of \p ns nanoseconds.
+	void record(std::uint64_t ns)
+	{
+		buckets[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/// The number of latencies recorded.
+	std::uint64_t count() const
+	{
+		std::uint64_t n = 0;
+		for (auto& b : buckets) { n += b.load(std::memory_order_relaxed); }
+		return n;
+	}
+
+	/// The latency in nanoseconds below which the fraction \p q (0 to 1) of the recorded latencies fall. Reports the upper edge of the bucket.
+	std::uint64_t percentile(double q) const
+	{
+		std::uint64_t total = count();
+		if (0 == total) { return 0; }
+		std::uint64_t target = static_cast<std::uint64_t>(q * total);
+		if (target >= total) { target = total - 1; }
+
+		std::uint64_t seen = 0;
+		for (std::size_t i = 0; i < bucketCount; ++i)
+		{
+			seen += buckets[i].load(std::memory_order_relaxed);
+			if (seen > target) { return upperEdge(i); }
+		}
+		return upperEdge(bucketCount - 1);
+	}
+
+private:
+	static const std::size_t subBits = 4;
+	static const std::size_t bucketCount = (64 - subBits + 1) << subBits;
+
+	static std::size_t bucketOf(std::uint64_t v)
+	{
+		if (v < (1u << subBits)) { return static_cast<std::size_t>(v); }
+		std::size_t top = 63;
+		while (0 == (v >> top)) { --top; }
+		std::size_t shift = top - subBits;
+		return ((shift + 1) << subBits) + static_cast<std::size_t>((v >> shift) & ((1u << subBits) - 1));
+	}
+
+	static std::uint64_t upperEdge(std::size_t i)
+	{
+		if (i < (1u << subBits)) { return i; }
+		std::size_t shift = (i >> subBits) - 1;
+		std::uint64_t base = (static_cast<std::uint64_t>((1u << subBits) | (i & ((1u << subBits) - 1)))) << shift;
+		return base + ((std::uint64_t(1) << shift) - 1);
+	}
+
+	std::atomic<std::uint64_t> buckets[bucketCount];
+};
+
+/// \class SoakProbe
+/// \brief A module which measures the latency of SyntheticEvents. Put it last in the Pipeline.
+///
+/// The probe counts every bundle it sees and records the time since each SyntheticEvent was made. SoakHarness uses the count to detect stalls.
+class SoakProbe : public Module
+{
+public:
+	/// Constructor.
+	SoakProbe()
+		: 	bundles(0)
+	{
+		// do nothing else
+	}
+
+	/// Destructor
+	virtual ~SoakProbe() {;}
+
+	/// The number of bundles seen so far. Threadsafe.
+	std::uint64_t bundleCount() const { return bundles.load(); }
+
+	/// Latencies of the SyntheticEvents seen so far.
+	const LatencyHistogram& getLatencies() const { return latencies; }
+
+protected:
+	/// Counts the bundle and records its latency.
+	virtual void processData() override
+	{
+		if (eventAccess.hasMessage(bundle))
+		{
+			const SyntheticEvent& event = eventAccess.readRef(bundle);
+			std::uint64_t now = SyntheticEvent::Now();
+			latencies.record(now > event.createdNs ? now - event.createdNs : 0);
+		}
+		++bundles;
+	}
+
+	std::atomic<std::uint64_t> bundles;
+	LatencyHistogram latencies;
+	BundleAccess<SyntheticEvent> eventAccess;
+};
+
+/// \class SoakHarness
+/// \brief Runs a Pipeline for a fixed time and reports how well it kept up.
+///
+/// The harness runs the pipeline on a separate thread and watches the bundle count of a SoakProbe. If the count does not move for the stall timeout, a stall is counted. When the time is up the pipeline is terminated; if it does not shut down within the shutdown timeout it is reported as deadlocked. In that case the pipeline thread is detached and keeps running, so the caller should report and exit rather than destroy the pipeline's modules.
+class SoakHarness
+{
+public:
+	/// The results of a soak run.
+	struct Report
+	{
+		Report()
+			: 	seconds(0), bundles(0), bundlesPerSecond(0), p50Ns(0), p90Ns(0), p99Ns(0), p999Ns(0), maxNs(0),
+				memoryHighWaterBytes(0), stalls(0), longestStallSeconds(0), deadlocked(false)
+		{
+			// do nothing else
+		}
+
+		/// Time from start until the pipeline was told to stop.
+		double seconds;
+		/// Bundles seen by the probe.
+		std::uint64_t bundles;
+		/// Sustained throughput.
+		double bundlesPerSecond;
+		/// Latency percentiles, from event creation to the probe.
+		std::uint64_t p50Ns, p90Ns, p99Ns, p999Ns, maxNs;
+		/// Peak resident memory of the process (VmHWM). 0 if the platform does not report it.
+		std::uint64_t memoryHighWaterBytes;
+		/// Number of times the probe saw no new bundle for the stall timeout.
+		std::uint64_t stalls;
+		/// The longest time the probe saw no new bundle.
+		double longestStallSeconds;
+		/// The pipeline did not shut down after being terminated.
+		bool deadlocked;
+
+		/// Print the report to \p os.
+		void print(std::ostream& os) const
+		{
+			os << "soak: " << seconds << " s, " << bundles << " bundles, " << bundlesPerSecond << " bundles/s\n"
+				<< "latency us: p50 " << p50Ns / 1e3 << ", p90 " << p90Ns / 1e3 << ", p99 " << p99Ns / 1e3
+				<< ", p99.9 " << p999Ns / 1e3 << ", max " << maxNs / 1e3 << "\n"
+				<< "memory high water: " << memoryHighWaterBytes / (1024.0 * 1024.0) << " MiB\n"
+				<< "stalls: " << stalls << " (longest " << longestStallSeconds << " s)"
+				<< (deadlocked ? ", DEADLOCKED\n" : "\n");
+		}
+	};
+
+	/// Constructor. \p pipeline must have \p probe connected as its last module.
+	SoakHarness(Pipeline& pipeline, SoakProbe& probe)
+		: 	pipeline(pipeline), probe(probe)
+	{
+		// do nothing else
+	}
+
+	/// Run the pipeline for \p duration and report. A stall is counted when no bundle reaches the probe for \p stallTimeout. The pipeline is reported as deadlocked if it has not stopped \p shutdownTimeout after being terminated.
+	Report run(std::chrono::milliseconds duration,
+		std::chrono::milliseconds stallTimeout = std::chrono::milliseconds(2000),
+		std::chrono::milliseconds shutdownTimeout = std::chrono::milliseconds(10000))
+	{
+		typedef std::chrono::steady_clock Clock;
+		std::chrono::milliseconds poll(std::min<std::chrono::milliseconds::rep>(50, std::max<std::chrono::milliseconds::rep>(1, stallTimeout.count() / 4)));
+
+		Report report;
+		std::shared_ptr<std::atomic<bool>> done = std::make_shared<std::atomic<bool>>(false);
+		Pipeline& p = pipeline;
+		std::thread runner([&p, done]{ p(); *done = true; });
+
+		Clock::time_point start = Clock::now();
+		Clock::time_point lastProgress = start;
+		std::uint64_t lastCount = probe.bundleCount();
+		bool stalled = false;
+
+		while (Clock::now() - start < duration && false == *done)
+		{
+			std::this_thread::sleep_for(poll);
+			Clock::time_point now = Clock::now();
+			std::uint64_t count = probe.bundleCount();
+			if (count != lastCount)
+			{
+				lastCount = count;
+				lastProgress = now;
+				stalled = false;
+				continue;
+			}
+
+			double quiet = std::chrono::duration<double>(now - lastProgress).count();
+			report.longestStallSeconds = std::max(report.longestStallSeconds, quiet);
+			if (false == stalled && now - lastProgress >= stallTimeout)
+			{
+				stalled = true;
+				++report.stalls;
+			}
+		}
+
+		report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		report.bundles = probe.bundleCount();
+		pipeline.terminate();
+
+		Clock::time_point deadline = Clock::now() + shutdownTimeout;
+		while (false == *done && Clock::now() < deadline)
+		{
+			std::this_thread::sleep_for(poll);
+		}
+
+		if (*done)
+		{
+			runner.join();
+		}
+		else
+		{
+			report.deadlocked = true;
+			runner.detach();
+		}
+
+		report.bundlesPerSecond = report.seconds > 0 ? report.bundles / report.seconds : 0;
+		const LatencyHistogram& latencies = probe.getLatencies();
+		report.p50Ns = latencies.percentile(0.5);
+		report.p90Ns = latencies.percentile(0.9);
+		report.p99Ns = latencies.percentile(0.99);
+		report.p999Ns = latencies.percentile(0.999);
+		report.maxNs = latencies.percentile(1.0);
+		report.memoryHighWaterBytes = MemoryHighWater();
+		return report;
+	}
+
+	/// Peak resident memory of this process in bytes, read from /proc/self/status. Returns 0 where that is not available.
+	static std::uint64_t MemoryHighWater()
+	{
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while (std::getline(status, line))
+		{
+			if (line.compare(0, 6, "VmHWM:") != 0) { continue; }
+			std::istringstream fields(line.substr(6));
+			std::uint64_t kb = 0;
+			fields >> kb;
+			return kb * 1024;
+		}
+		return 0;
+	}
+
+private:
+	Pipeline& pipeline;
+	SoakProbe& probe;
+};
+
+} // namespace pipe
+
+#endif
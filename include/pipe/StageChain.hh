@@ -0,0 +1,171 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2014 John Sparger <jsparger87@gmail.com>
+//
+// Distributed under the Boost Software License, Version 1.0
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// See https://github.com/jsparger/pipe for more information.
+//---------------------------------------------------------------------------//
+
+#ifndef PIPE_STAGE_CHAIN_HH
+#define PIPE_STAGE_CHAIN_HH
+
+#include "pipe/MultiModule.hh"
+#include <vector>
+
+namespace pipe {
+
+class StageChain;
+
+/// \class StageOutput
+/// \brief Passes bundles from a Stage to the stage after it.
+class StageOutput
+{
+public:
+	/// Pass \p b to the next stage. The next stage runs right away, on the same thread, before this call returns.
+	inline void emit(std::unique_ptr<MessageBundle> b);
+
+private:
+	friend class StageChain;
+
+	StageOutput(StageChain& chain, std::size_t index)
+		: 	chain(chain), index(index)
+	{
+		// do nothing else
+	}
+
+	StageChain& chain;
+	std::size_t index;
+};
+
+/// \class Stage
+/// \brief Abstract base class for lightweight stages which share a thread.
+///
+/// A Stage is a cheaper alternative to a Module for the many small steps of an analysis. It has no thread, mutexes or condition variable of its own. Instead, a StageChain calls process() for every bundle and the stage passes on whatever it wants to with StageOutput::emit(): the same bundle, several new ones, or nothing at all. The hooks mirror those of Module.
+class Stage
+{
+public:
+	/// Destructor
+	virtual ~Stage() {;}
+
+	/// Process one bundle and emit any bundles that should continue down the chain.
+	virtual void process(std::unique_ptr<MessageBundle> bundle, StageOutput& out) = 0;
+
+	/// A hook to perform any initialization the stage might need. Called on the thread of the StageChain before the first bundle.
+	virtual void initialize()
+	{
+		// do nothing
+	}
+
+	/// A hook which is called whenever a soft-reset control message is received. Emit anything the stage is still holding from the segment which just ended (a partial batch, for example) to \p out, so it stays ahead of the reset.
+	virtual void reset(StageOutput& /*out*/)
+	{
+		// do nothing
+	}
+
+	/// Called at shutdown, after the last bundle, to emit anything the stage is still holding (a partial batch, for example).
+	virtual void flush(StageOutput& /*out*/)
+	{
+		// do nothing
+	}
+
+	/// A hook to perform any cleanup the stage might need. Called after flush().
+	virtual void cleanUp()
+	{
+		// do nothing
+	}
+};
+
+/// \class StageChain
+/// \brief A Module which runs a chain of Stages on its own single thread.
+///
+/// To the Pipeline, a StageChain is an ordinary module, so it can be mixed freely with thread-based Modules: a whole analysis can run in one StageChain, or several StageChains can spread the stages over a few threads. Passing a bundle from one stage to the next is a plain function call. Because stages may emit any number of bundles, StageChain is a MultiModule.
+///
+/// A SOFT_RESET calls reset() on every stage, in order, before the bundle enters the chain. Whatever a stage emits from reset() passes through the stages after it before they are reset, and reaches downstream modules before the control message does. At SHUTDOWN the last bundle goes through the chain, then every stage is flushed in order, and only then is the control message passed on, so nothing a stage was holding is lost.
+class StageChain : public MultiModule
+{
+public:
+	/// Constructor.
+	StageChain() {;}
+
+	/// Destructor
+	virtual ~StageChain() {;}
+
+	/// Add \p stage to the end of the chain. Returns *this for chaining calls. Must be called before the module is started.
+	virtual StageChain& add(Stage& stage)
+	{
+		stages.push_back(&stage);
+		return *this;
+	}
+
+protected:
+	friend class StageOutput;
+
+	/// Calls initialize() on every stage.
+	virtual void initialize() override
+	{
+		outputs.clear();
+		for (std::size_t i = 0; i < stages.size(); ++i)
+		{
+			outputs.push_back(StageOutput(*this, i + 1));
+			stages[i]->initialize();
+		}
+	}
+
+	/// Runs the bundle through the stages.
+	virtual void processData() override
+	{
+		deliver(0, std::move(bundle));
+	}
+
+	/// Calls flush() on every stage, in order, so each one's leftovers pass through the stages after it. MultiModule puts the shutdown after anything they emit.
+	virtual void flush() override
+	{
+		for (std::size_t i = 0; i < stages.size(); ++i)
+		{
+			stages[i]->flush(outputs[i]);
+		}
+	}
+
+	/// Calls reset() on every stage, in order. MultiModule puts the control message after anything they emit.
+	virtual void reset() override
+	{
+		for (std::size_t i = 0; i < stages.size(); ++i)
+		{
+			stages[i]->reset(outputs[i]);
+		}
+	}
+
+	/// Calls cleanUp() on every stage.
+	virtual void cleanUp() override
+	{
+		for (auto stage : stages) { stage->cleanUp(); }
+		MultiModule::cleanUp();
+	}
+
+	/// Hand \p b to stage \p index, or emit it from the module if it has passed every stage.
+	virtual void deliver(std::size_t index, std::unique_ptr<MessageBundle> b)
+	{
+		if (!b) { return; }
+		if (index == stages.size())
+		{
+			emit(std::move(b));
+			return;
+		}
+		stages[index]->process(std::move(b), outputs[index]);
+	}
+
+	std::vector<Stage*> stages;
+	/// outputs[i] feeds stage i + 1.
+	std::vector<StageOutput> outputs;
+};
+
+inline void StageOutput::emit(std::unique_ptr<MessageBundle> b)
+{
+	chain.deliver(index, std::move(b));
+}
+
+} // namespace pipe
+
+#endif
@@ -0,0 +1,207 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2014 John Sparger <jsparger87@gmail.com>
+//
+// Distributed under the Boost Software License, Version 1.0
+// See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt
+//
+// See https://github.com/jsparger/pipe for more information.
+//---------------------------------------------------------------------------//
+
+#ifndef PIPE_SYNTHETIC_SOURCE_HH
+#define PIPE_SYNTHETIC_SOURCE_HH
+
+#include "pipe/Module.hh"
+#include "pipe/Interrupt.hh"
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pipe {
+
+/// \class SyntheticEvent
+/// \brief A fake detector event produced by SyntheticSource.
+struct SyntheticEvent : public Message
+{
+	/// Constructor.
+	SyntheticEvent()
+		: 	sequence(0), createdNs(0)
+	{
+		// do nothing else
+	}
+
+	/// Destructor.
+	virtual ~SyntheticEvent() {;}
+
+	/// An override from message which will print out details of the message.
+	virtual void serialize(std::ostream& os) const override
+	{
+		os << GetMessageType() << ": sequence = " << sequence << ", samples = " << samples.size();
+	}
+
+	/// A static method allowing this class to be used by BundleAccess. Provides the type of message.
+	static const std::string& GetMessageType()
+	{
+		static std::string MessageType = "pipe::SyntheticEvent";
+		return MessageType;
+	}
+
+	/// The memory held by the event, for MemoryAccounting.
+	std::size_t byteSize() const
+	{
+		return sizeof(*this) + samples.capacity() * sizeof(std::uint16_t);
+	}
+
+	/// The current time on the clock used for createdNs, in nanoseconds.
+	static std::uint64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	/// The number of the event, starting from 0.
+	std::uint64_t sequence;
+	/// When the event was made, from Now(). Used to measure latency.
+	std::uint64_t createdNs;
+	/// The fake waveform.
+	std::vector<std::uint16_t> samples;
+};
+
+/// \class SyntheticSource
+/// \brief A module which fills bundles with synthetic detector events at a controlled rate.
+///
+/// Put a SyntheticSource first in a Pipeline to drive it without real hardware. Each bundle gets one SyntheticEvent with a waveform of random length. Events can arrive as fast as possible, at a fixed rate, as a Poisson process, or in bursts. The source can also attach BREAK_POINT interrupts at random and a FINISHED interrupt after a set number of events.
+class SyntheticSource : public Module
+{
+public:
+	/// How event arrival times are chosen.
+	enum class Arrival
+	{
+		UNTHROTTLED, ///< As fast as the pipeline will take them.
+		FIXED, ///< Evenly spaced at the configured rate.
+		POISSON, ///< Exponentially distributed gaps with the configured mean rate.
+		BURSTY ///< Bursts of burstSize back-to-back events, with the bursts arriving as a Poisson process. The mean rate is the configured rate.
+	};
+
+	/// Settings for a SyntheticSource.
+	struct Config
+	{
+		Config()
+			: 	arrival(Arrival::UNTHROTTLED), rate(1000), burstSize(100),
+				minSamples(64), maxSamples(1024), breakPointProbability(0),
+				maxEvents(0), seed(5489u)
+		{
+			// do nothing else
+		}
+
+		Arrival arrival;
+		/// Mean events per second. Not used when arrival is UNTHROTTLED.
+		double rate;
+		/// Events per burst for BURSTY arrival.
+		std::uint64_t burstSize;
+		/// Smallest waveform length, in samples.
+		std::size_t minSamples;
+		/// Largest waveform length, in samples.
+		std::size_t maxSamples;
+		/// Chance that an event carries a BREAK_POINT interrupt.
+		double breakPointProbability;
+		/// Attach a FINISHED interrupt to this event number. 0 means never finish.
+		std::uint64_t maxEvents;
+		/// Seed for the random number generator, so runs can be repeated.
+		std::uint32_t seed;
+	};
+
+	/// Constructor. Takes the settings \p config.
+	SyntheticSource(const Config& config = Config())
+		: 	config(config), engine(config.seed), sequence(0), inBurst(0)
+	{
+		// do nothing else
+	}
+
+	/// Destructor
+	virtual ~SyntheticSource() {;}
+
+protected:
+
+	/// Starts the arrival clock.
+	virtual void initialize() override
+	{
+		nextArrival = Clock::now();
+	}
+
+	/// Waits until the next arrival time and attaches a new event.
+	virtual void processData() override
+	{
+		waitForArrival();
+
+		SyntheticEvent event;
+		event.sequence = sequence++;
+		std::uniform_int_distribution<std::size_t> length(config.minSamples, config.maxSamples);
+		event.samples.resize(length(engine));
+		std::uniform_int_distribution<unsigned> noise(0, 15);
+		for (auto& s : event.samples) { s = static_cast<std::uint16_t>(1000 + noise(engine)); }
+		event.createdNs = SyntheticEvent::Now();
+		eventAccess.attachTo(bundle, event);
+
+		if (config.maxEvents && sequence == config.maxEvents)
+		{
+			interruptAccess.attachTo(bundle, Interrupt(Interrupt::Type::FINISHED));
+		}
+		else if (config.breakPointProbability > 0 && std::bernoulli_distribution(config.breakPointProbability)(engine))
+		{
+			interruptAccess.attachTo(bundle, Interrupt(Interrupt::Type::BREAK_POINT));
+		}
+	}
+
+	/// Sleeps until the next event is due according to the arrival model.
+	virtual void waitForArrival()
+	{
+		if (Arrival::UNTHROTTLED == config.arrival || config.rate <= 0) { return; }
+
+		std::this_thread::sleep_until(nextArrival);
+
+		double gap = 0;
+		if (Arrival::FIXED == config.arrival)
+		{
+			gap = 1.0 / config.rate;
+		}
+		else if (Arrival::POISSON == config.arrival)
+		{
+			gap = std::exponential_distribution<double>(config.rate)(engine);
+		}
+		else if (Arrival::BURSTY == config.arrival)
+		{
+			// events inside a burst come back-to-back. Bursts come at
+			// rate / burstSize so the mean rate stays the same.
+			std::uint64_t size = config.burstSize ? config.burstSize : 1;
+			if (++inBurst >= size)
+			{
+				inBurst = 0;
+				gap = std::exponential_distribution<double>(config.rate / size)(engine);
+			}
+		}
+
+		nextArrival += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(gap));
+
+		// if we fell far behind, don't try to catch up with a flood.
+		Clock::time_point now = Clock::now();
+		if (nextArrival < now - std::chrono::seconds(1)) { nextArrival = now; }
+	}
+
+	typedef std::chrono::steady_clock Clock;
+
+	Config config;
+	std::mt19937 engine;
+	std::uint64_t sequence;
+	std::uint64_t inBurst;
+	Clock::time_point nextArrival;
+	BundleAccess<SyntheticEvent> eventAccess;
+	BundleAccess<Interrupt> interruptAccess;
+};
+
+} // namespace pipe
+
+#endif